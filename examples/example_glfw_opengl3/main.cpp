@@ -34,6 +34,36 @@ void glfwMouseBtnCallback(GLFWwindow* window, int btn, int action, int mods)
     io.mouseBtns[btn] = action == GLFW_PRESS;
 }
 
+void glfwKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    auto& io = retgui::get_current_context()->io;
+    io.keyShift = (mods & GLFW_MOD_SHIFT) != 0;
+    if (action == GLFW_RELEASE)
+    {
+        return;
+    }
+
+    switch (key)
+    {
+        case GLFW_KEY_LEFT: io.add_key_pressed(retgui::Key::Left); break;
+        case GLFW_KEY_RIGHT: io.add_key_pressed(retgui::Key::Right); break;
+        case GLFW_KEY_UP: io.add_key_pressed(retgui::Key::Up); break;
+        case GLFW_KEY_DOWN: io.add_key_pressed(retgui::Key::Down); break;
+        case GLFW_KEY_HOME: io.add_key_pressed(retgui::Key::Home); break;
+        case GLFW_KEY_END: io.add_key_pressed(retgui::Key::End); break;
+        case GLFW_KEY_BACKSPACE: io.add_key_pressed(retgui::Key::Backspace); break;
+        case GLFW_KEY_DELETE: io.add_key_pressed(retgui::Key::Delete); break;
+        case GLFW_KEY_ENTER: io.add_key_pressed(retgui::Key::Enter); break;
+        default: break;
+    }
+}
+
+void glfwCharCallback(GLFWwindow* window, unsigned int codepoint)
+{
+    auto& io = retgui::get_current_context()->io;
+    io.add_input_character(codepoint);
+}
+
 void APIENTRY
 glDebugOutput(GLenum source, GLenum type, unsigned int id, GLenum severity, GLsizei length, const char* message, const void* userParam)
 {
@@ -91,12 +121,13 @@ out vec2 frag_texCoord;
 out vec4 frag_color;
 
 uniform mat4 u_projMatrix;
+uniform vec2 u_translation;
 
 void main()
 {
     frag_texCoord = in_texCoord;
     frag_color = in_color;
-    gl_Position = u_projMatrix * vec4(in_position.xy, 0.0, 1.0);
+    gl_Position = u_projMatrix * vec4(in_position.xy + u_translation, 0.0, 1.0);
 }
 )";
 
@@ -109,13 +140,61 @@ in vec4 frag_color;
 out vec4 out_fragColor;
 
 uniform sampler2D u_texture;
+uniform float u_opacity;
 
 void main()
 {
     out_fragColor = frag_color * texture(u_texture, frag_texCoord.st);
+    out_fragColor.a *= u_opacity;
+}
+)";
+
+#ifdef RETGUI_TEXTURE_SLOTS
+const char* OGLSlotVertexShaderSrc = R"(
+#version 130
+
+in vec2 in_position;
+in vec2 in_texCoord;
+in vec4 in_color;
+in uint in_slot;
+
+out vec2 frag_texCoord;
+out vec4 frag_color;
+flat out uint frag_slot;
+
+uniform mat4 u_projMatrix;
+uniform vec2 u_translation;
+
+void main()
+{
+    frag_texCoord = in_texCoord;
+    frag_color = in_color;
+    frag_slot = in_slot;
+    gl_Position = u_projMatrix * vec4(in_position.xy + u_translation, 0.0, 1.0);
 }
 )";
 
+// GLSL 1.30 only allows indexing sampler arrays with constants, so every slot gets its own branch.
+std::string retgui_opengl3_slot_fragment_shader_source()
+{
+    const auto slotCount = std::to_string(RETGUI_TEXTURE_SLOTS);
+    std::string source = "#version 130\n\n"
+                         "in vec2 frag_texCoord;\n"
+                         "in vec4 frag_color;\n"
+                         "flat in uint frag_slot;\n\n"
+                         "out vec4 out_fragColor;\n\n"
+                         "uniform sampler2D u_textures["
+                         + slotCount + "];\nuniform float u_opacity;\n\nvoid main()\n{\n    vec4 texColor = vec4(1.0);\n";
+    for (int slot = 0; slot < RETGUI_TEXTURE_SLOTS; ++slot)
+    {
+        const auto index = std::to_string(slot);
+        source += "    if (frag_slot == " + index + "u) texColor = texture(u_textures[" + index + "], frag_texCoord.st);\n";
+    }
+    source += "    out_fragColor = frag_color * texColor;\n    out_fragColor.a *= u_opacity;\n}\n";
+    return source;
+}
+#endif
+
 struct DrawData
 {
     GLuint vao;
@@ -130,6 +209,23 @@ struct DrawData
 };
 static DrawData g_oglDrawData{};
 
+// GL 3.0 has no glDrawElementsBaseVertex, so a command's VertexOffset is applied by moving the attribute pointers instead.
+void retgui_opengl3_set_vertex_attribs(std::size_t vertexOffset)
+{
+    const auto base = vertexOffset * sizeof(retgui::DrawVert);
+#ifdef RETGUI_USE_COMPACT_VERTICES
+    glVertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, sizeof(retgui::DrawVert), (void*)(base + offsetof(retgui::DrawVert, pos)));
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(retgui::DrawVert), (void*)(base + offsetof(retgui::DrawVert, uv)));
+#else
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(retgui::DrawVert), (void*)(base + offsetof(retgui::DrawVert, pos)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(retgui::DrawVert), (void*)(base + offsetof(retgui::DrawVert, uv)));
+#endif
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(retgui::DrawVert), (void*)(base + offsetof(retgui::DrawVert, col)));
+#ifdef RETGUI_TEXTURE_SLOTS
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, sizeof(retgui::DrawVert), (void*)(base + offsetof(retgui::DrawVert, slot)));
+#endif
+}
+
 void retgui_opengl_init()
 {
     glGenVertexArrays(1, &g_oglDrawData.vao);
@@ -138,11 +234,12 @@ void retgui_opengl_init()
     glGenBuffers(1, &g_oglDrawData.vertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, g_oglDrawData.vertexBuffer);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(retgui::DrawVert), (void*)offsetof(retgui::DrawVert, pos));
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(retgui::DrawVert), (void*)offsetof(retgui::DrawVert, uv));
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(retgui::DrawVert), (void*)offsetof(retgui::DrawVert, col));
+#ifdef RETGUI_TEXTURE_SLOTS
+    glEnableVertexAttribArray(3);
+#endif
+    retgui_opengl3_set_vertex_attribs(0);
 
     glGenBuffers(1, &g_oglDrawData.indexBuffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_oglDrawData.indexBuffer);
@@ -150,7 +247,11 @@ void retgui_opengl_init()
     glBindVertexArray(0);
 
     auto vertShader = glCreateShader(GL_VERTEX_SHADER);
+#ifdef RETGUI_TEXTURE_SLOTS
+    glShaderSource(vertShader, 1, &OGLSlotVertexShaderSrc, nullptr);
+#else
     glShaderSource(vertShader, 1, &OGLVertexShaderSrc, nullptr);
+#endif
     glCompileShader(vertShader);
 
     {
@@ -165,7 +266,13 @@ void retgui_opengl_init()
     }
 
     auto fragShader = glCreateShader(GL_FRAGMENT_SHADER);
+#ifdef RETGUI_TEXTURE_SLOTS
+    const auto slotFragmentShaderSrc = retgui_opengl3_slot_fragment_shader_source();
+    const char* fragmentShaderSrc = slotFragmentShaderSrc.c_str();
+    glShaderSource(fragShader, 1, &fragmentShaderSrc, nullptr);
+#else
     glShaderSource(fragShader, 1, &OGLFragmentShaderSrc, nullptr);
+#endif
     glCompileShader(fragShader);
 
     {
@@ -182,6 +289,12 @@ void retgui_opengl_init()
     g_oglDrawData.program = glCreateProgram();
     glAttachShader(g_oglDrawData.program, vertShader);
     glAttachShader(g_oglDrawData.program, fragShader);
+    glBindAttribLocation(g_oglDrawData.program, 0, "in_position");
+    glBindAttribLocation(g_oglDrawData.program, 1, "in_texCoord");
+    glBindAttribLocation(g_oglDrawData.program, 2, "in_color");
+#ifdef RETGUI_TEXTURE_SLOTS
+    glBindAttribLocation(g_oglDrawData.program, 3, "in_slot");
+#endif
     glLinkProgram(g_oglDrawData.program);
 
     {
@@ -207,22 +320,31 @@ void retgui_opengl_init()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, whitePixel);
 
+    auto& fonts = retgui::get_current_context()->io.Fonts;
     std::uint32_t width{};
     std::uint32_t height{};
     std::vector<std::uint32_t> textureData{};
-    retgui::get_current_context()->io.Fonts.get_texture_data_as_rgba32(textureData, width, height);
+    fonts.get_texture_data_as_rgba32(textureData, width, height);
 
-    GLuint fontTextureId{};
-    glGenTextures(1, &fontTextureId);
-    glBindTexture(GL_TEXTURE_2D, fontTextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, textureData.data());
+    for (std::uint32_t page = 0; page < fonts.get_page_count(); ++page)
+    {
+        if (page != 0)
+        {
+            fonts.get_texture_data_as_rgba32(textureData, width, height, page);
+        }
 
-    retgui::get_current_context()->io.Fonts.set_tex_id(fontTextureId);
+        GLuint fontTextureId{};
+        glGenTextures(1, &fontTextureId);
+        glBindTexture(GL_TEXTURE_2D, fontTextureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, textureData.data());
+
+        fonts.set_tex_id(fontTextureId, page);
+    }
 
     glBindTexture(GL_TEXTURE_2D, 0);
 }
@@ -251,6 +373,14 @@ void retgui_opengl3_setup_render_state()
 
     glUseProgram(g_oglDrawData.program);
     glUniformMatrix4fv(glGetUniformLocation(g_oglDrawData.program, "u_projMatrix"), 1, GL_FALSE, &orthoProjection[0][0]);
+#ifdef RETGUI_TEXTURE_SLOTS
+    GLint textureUnits[RETGUI_TEXTURE_SLOTS];
+    for (GLint slot = 0; slot < RETGUI_TEXTURE_SLOTS; ++slot)
+    {
+        textureUnits[slot] = slot;
+    }
+    glUniform1iv(glGetUniformLocation(g_oglDrawData.program, "u_textures"), RETGUI_TEXTURE_SLOTS, textureUnits);
+#endif
 
     glBindVertexArray(g_oglDrawData.vao);
 }
@@ -277,11 +407,46 @@ void retgui_opengl3_render(const retgui::DrawData* drawData)
 
     retgui_opengl3_setup_render_state();
 
-    for (auto cmd : drawData->DrawCmds)
+    const GLenum indexType = sizeof(retgui::DrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    retgui::U32 vertexOffset = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, g_oglDrawData.vertexBuffer);
+    retgui_opengl3_set_vertex_attribs(vertexOffset);
+
+    // Layers are moved & faded through uniforms, so patching them needs no new vertices.
+    const auto translationLocation = glGetUniformLocation(g_oglDrawData.program, "u_translation");
+    const auto opacityLocation = glGetUniformLocation(g_oglDrawData.program, "u_opacity");
+    retgui::U32 layerIdx = 0;
+    glUniform2f(translationLocation, 0.0f, 0.0f);
+    glUniform1f(opacityLocation, 1.0f);
+
+    for (const auto& cmd : drawData->DrawCmds)
     {
+#ifdef RETGUI_TEXTURE_SLOTS
+        for (retgui::U32 slot = 0; slot < cmd.TextureCount; ++slot)
+        {
+            glActiveTexture(GL_TEXTURE0 + slot);
+            glBindTexture(GL_TEXTURE_2D, GLuint(cmd.Textures[slot]));
+        }
+        glActiveTexture(GL_TEXTURE0);
+#else
         glBindTexture(GL_TEXTURE_2D, GLuint(cmd.TextureId));
+#endif
 
-        glDrawElements(GL_TRIANGLES, cmd.IndexCount, GL_UNSIGNED_INT, (void*)(cmd.IndexOffset * sizeof(retgui::U32)));
+        if (cmd.LayerIdx != layerIdx)
+        {
+            layerIdx = cmd.LayerIdx;
+            const auto& layer = drawData->Layers[layerIdx];
+            glUniform2f(translationLocation, layer.Translation.x, layer.Translation.y);
+            glUniform1f(opacityLocation, layer.Opacity);
+        }
+
+        if (cmd.VertexOffset != vertexOffset)
+        {
+            vertexOffset = cmd.VertexOffset;
+            retgui_opengl3_set_vertex_attribs(vertexOffset);
+        }
+
+        glDrawElements(GL_TRIANGLES, cmd.IndexCount, indexType, (void*)(cmd.IndexOffset * sizeof(retgui::DrawIdx)));
     }
 }
 
@@ -305,6 +470,8 @@ int main(int argc, char** argv)
 
     glfwSetCursorPosCallback(window, glfwCursorPosCallback);
     glfwSetMouseButtonCallback(window, glfwMouseBtnCallback);
+    glfwSetKeyCallback(window, glfwKeyCallback);
+    glfwSetCharCallback(window, glfwCharCallback);
 
     if (!gladLoadGL((GLADloadfunc)glfwGetProcAddress))
     {
@@ -368,6 +535,13 @@ int main(int argc, char** argv)
         "1234567890");
     retgui::add_to_root(someLabel);
 
+    auto textBox = retgui::create_element<retgui::TextBox>();
+    textBox->set_position(retgui::Dim2{ retgui::Dim(0, 10), retgui::Dim(0.75f, 0) });
+    textBox->set_size(retgui::Dim2{ retgui::Dim(0.5f, 0), retgui::Dim(0.25f, -10) });
+    textBox->set_font(font32);
+    textBox->set_text("Click here to edit.\nShift + arrows to select.");
+    retgui::add_to_root(textBox);
+
     while (!glfwWindowShouldClose(window))
     {
         glfwPollEvents();
@@ -3,10 +3,13 @@
 #include "retgui.hpp"
 #include "types.hpp"
 #include "fonts.hpp"
+#include "text.hpp"
 
 #include <memory>
 #include <string>
+#include <algorithm>
 #include <functional>
+#include <unordered_map>
 #include <type_traits>
 
 namespace retgui
@@ -16,6 +19,7 @@ namespace retgui
 #define RETGUI_ELEMENT_STATE_ACTIVE U8(1u << 2u)   // 4
 
     class Element;
+    enum class Key : U8;
 
     template <typename T>
     using ElementPtr = std::shared_ptr<T>;
@@ -36,6 +40,11 @@ namespace retgui
 
         void update();
         virtual void render(DrawData& drawData) const;
+        /* Called by render() on every element once the font atlas was rebuilt, so cached glyph metrics can be dropped. */
+        virtual void on_atlas_rebuilt() {}
+        /* Used by render() around this element & its children: opens and closes the DrawLayer of a layer root. */
+        void begin_layer(DrawData& drawData) const;
+        void end_layer(DrawData& drawData) const;
 
         auto get_parent() const -> ElementBasePtr;
         auto get_prev_sibling() const -> ElementBasePtr;
@@ -53,13 +62,40 @@ namespace retgui
         auto set_position(const Dim2& position) -> ElementBasePtr;
         auto set_size(const Dim2& size) -> ElementBasePtr;
 
+        /* Use expressions instead of the position/size Dims, until set_position()/set_size() is called again. */
+        auto set_position_expr(const DimExpr& x, const DimExpr& y) -> ElementBasePtr;
+        auto set_size_expr(const DimExpr& x, const DimExpr& y) -> ElementBasePtr;
+
         auto get_screen_position() const -> Vec2;
         auto get_screen_size() const -> Vec2;
         auto get_bounds() const -> Rect;
 
+        /* Preferred size when placed by a layout container (eg. a VStack). Cached until invalidate_measure(). */
+        auto get_measured_size() const -> Vec2;
+        /* Must be called when anything measure() depends on changes. Also invalidates a layout container parent. */
+        void invalidate_measure();
+
+        auto get_flex_grow() const -> float { return m_flexGrow; }
+        auto get_flex_shrink() const -> float { return m_flexShrink; }
+        /* How much of the free (or missing) space this element takes when placed by a layout container. Neither by default. */
+        auto set_flex(float grow, float shrink = 0.0f) -> ElementBasePtr;
+
         auto get_texture() const -> TexId { return m_texture; }
         void set_texture(TexId texture);
 
+        /*
+         * A layer root and everything below it are drawn with a translation & opacity that the backend applies, so changing
+         * them only patches a DrawLayer instead of emitting the vertices again. Meant for scrolling, dragging and fading.
+         */
+        bool is_layer_root() const { return m_layerRoot; }
+        auto set_layer_root(bool layerRoot) -> ElementBasePtr;
+        auto get_layer_translation() const -> const Vec2& { return m_layerTranslation; }
+        auto set_layer_translation(const Vec2& translation) -> ElementBasePtr;
+        auto get_layer_opacity() const -> float { return m_layerOpacity; }
+        auto set_layer_opacity(float opacity) -> ElementBasePtr;
+        /* The layer translations of this element and its ancestors: where it is drawn relative to its screen position. */
+        auto get_layer_offset() const -> Vec2;
+
         auto get_color() const -> const Color& { return m_color; }
         auto set_color(const Color& color) -> ElementBasePtr;
 
@@ -73,6 +109,8 @@ namespace retgui
 
         virtual void on_mouse_button_down(int button) {}
         virtual void on_mouse_button_up(int button) {}
+        virtual void on_key_pressed(Key) {}
+        virtual void on_text_input(U32) {}
 
     protected:
         auto get_hovered_color() const -> const Color& { return m_hoveredColor; }
@@ -83,6 +121,30 @@ namespace retgui
 
         void set_enabled_states(U8 states);
 
+        virtual auto measure() const -> Vec2;
+
+        /*
+         * Layout containers return TRUE and place all of their children in arrange() through set_arranged_rect(), in which case
+         * the children's position & size Dims are ignored. arrange() is only called again after invalidate_arrange() or a resize.
+         */
+        virtual bool arranges_children() const { return false; }
+        virtual void arrange(const Vec2&) const {}
+        static void set_arranged_rect(const Element& child, const Rect& rect);
+        void invalidate_arrange();
+        /* Called on a layout container when a child's measured size changes. */
+        virtual void on_child_measure_invalidated(const Element& child);
+        /* Called after a child has been unlinked by remove_child(), so containers can drop what they keep per child. */
+        virtual void on_child_removed(const Element&) {}
+
+    private:
+        void ensure_arranged() const;
+        /* Screen position & size are cached until invalidate_layout() is called on this element or an ancestor it depends on. */
+        void update_layout() const;
+        void invalidate_layout(bool positionChanged, bool sizeChanged) const;
+        bool scales_position() const;
+        bool scales_size() const;
+        void patch_layer();
+
     private:
         ElementBasePtr m_parent{ nullptr };
         ElementBasePtr m_prevSibling{ nullptr };
@@ -92,6 +154,8 @@ namespace retgui
 
         Dim2 m_position{};
         Dim2 m_size{};
+        std::unique_ptr<DimExpr2> m_positionExpr{ nullptr };  // Only allocated when used, plain Dims stay the fast path
+        std::unique_ptr<DimExpr2> m_sizeExpr{ nullptr };
 
         TexId m_texture{};
         Color m_color{ Color::white() };
@@ -100,6 +164,171 @@ namespace retgui
 
         U8 m_state{};
         U8 m_enabledStates{};
+
+        float m_flexGrow{ 0.0f };
+        float m_flexShrink{ 0.0f };
+
+        bool m_layerRoot{ false };
+        Vec2 m_layerTranslation{};
+        float m_layerOpacity{ 1.0f };
+        mutable U32 m_layerIdx{};         // In DrawData::Layers, as of the render of m_layerGeneration
+        mutable U32 m_layerGeneration{};
+
+        mutable Vec2 m_screenPos{};
+        mutable Vec2 m_screenSize{};
+        mutable bool m_layoutValid{ false };
+
+        mutable Vec2 m_measuredSize{};
+        mutable bool m_measureValid{ false };
+        mutable Rect m_arrangedRect{};  // Relative to the parent. Only used if the parent arranges its children.
+        mutable Vec2 m_arrangedForSize{};
+        mutable bool m_arrangeValid{ false };
+    };
+
+    enum class StackAlign
+    {
+        Start,
+        Center,
+        End,
+        Stretch,
+    };
+
+    /*
+     * Places its children one after another along an axis, separated by a gap. Each child starts at its measured size, then
+     * free space is shared out by the children's flex grow factors (or missing space taken back by their shrink factors).
+     * Measured sizes are cached per child, so adding a child only measures the new one.
+     */
+    class Stack : public Element
+    {
+    public:
+        ~Stack() = default;
+
+        void render(DrawData&) const override {}
+
+        auto get_gap() const -> float { return m_gap; }
+        void set_gap(float gap);
+
+        /* Cross axis alignment of the children. */
+        auto get_align() const -> StackAlign { return m_align; }
+        void set_align(StackAlign align);
+
+        /* Main axis alignment of the children when none of them grow. Stretch behaves as Start. */
+        auto get_justify() const -> StackAlign { return m_justify; }
+        void set_justify(StackAlign justify);
+
+    protected:
+        explicit Stack(bool horizontal);
+
+        auto measure() const -> Vec2 override;
+        bool arranges_children() const override { return true; }
+        void arrange(const Vec2& size) const override;
+
+    private:
+        using Element::get_texture;
+        using Element::set_texture;
+
+    private:
+        bool m_horizontal{ false };
+        float m_gap{ 0.0f };
+        StackAlign m_align{ StackAlign::Stretch };
+        StackAlign m_justify{ StackAlign::Start };
+    };
+
+    enum class GridTrackType
+    {
+        Fixed,     // Value is in pixels
+        Fraction,  // Value is a share of the space left after all other tracks
+        Auto,      // Sized to the largest child in the track
+    };
+
+    struct GridTrack
+    {
+        GridTrackType Type{ GridTrackType::Auto };
+        float Value{};
+
+        static auto fixed(float pixels) -> GridTrack { return { GridTrackType::Fixed, pixels }; }
+        static auto fraction(float fraction) -> GridTrack { return { GridTrackType::Fraction, fraction }; }
+        static auto automatic() -> GridTrack { return { GridTrackType::Auto, 0.0f }; }
+    };
+
+    /*
+     * Places its children in cells of fixed, fractional & auto sized row/column tracks.
+     * Auto track sizes are cached and only recomputed for the tracks of a child whose measured size changed. Children spanning
+     * several tracks are placed across them but do not size auto tracks.
+     */
+    class Grid : public Element
+    {
+    public:
+        Grid() = default;
+        ~Grid() = default;
+
+        void render(DrawData&) const override {}
+
+        auto get_columns() const -> const std::vector<GridTrack>& { return m_columns.Tracks; }
+        void set_columns(const std::vector<GridTrack>& columns);
+        auto get_rows() const -> const std::vector<GridTrack>& { return m_rows.Tracks; }
+        void set_rows(const std::vector<GridTrack>& rows);
+
+        auto get_gap() const -> const Vec2& { return m_gap; }
+        void set_gap(const Vec2& gap);
+
+        using Element::add_child;
+        auto add_child(const ElementBasePtr& element, U32 row, U32 column, U32 rowSpan = 1, U32 columnSpan = 1) -> ElementBasePtr;
+        /* Moves a child to another cell. Children added without a cell are placed at (0, 0). */
+        void set_cell(const ElementBasePtr& element, U32 row, U32 column, U32 rowSpan = 1, U32 columnSpan = 1);
+
+    protected:
+        auto measure() const -> Vec2 override;
+        bool arranges_children() const override { return true; }
+        void arrange(const Vec2& size) const override;
+        void on_child_measure_invalidated(const Element& child) override;
+        void on_child_removed(const Element& child) override;
+
+    private:
+        struct GridCell
+        {
+            U32 Row{};
+            U32 Column{};
+            U32 RowSpan{ 1 };
+            U32 ColumnSpan{ 1 };
+        };
+
+        struct TrackList
+        {
+            std::vector<GridTrack> Tracks{};
+            mutable std::vector<float> ContentSizes{};  // Auto tracks only
+            mutable std::vector<bool> ContentDirty{};
+            mutable std::vector<float> Offsets{};  // Start of each track, plus the end of the last one
+            mutable float ResolvedForSize{ -1.0f };
+        };
+
+        auto get_cell(const Element& element) const -> GridCell;
+        void mark_tracks_dirty(const GridCell& cell);
+        void update_content_sizes() const;
+        void resolve_tracks(const TrackList& trackList, float size, float gap) const;
+
+    private:
+        using Element::get_texture;
+        using Element::set_texture;
+
+    private:
+        TrackList m_columns{};
+        TrackList m_rows{};
+        Vec2 m_gap{};
+        std::unordered_map<const Element*, GridCell> m_cells{};
+        mutable bool m_contentDirty{ true };
+    };
+
+    class HStack : public Stack
+    {
+    public:
+        HStack() : Stack(true) {}
+    };
+
+    class VStack : public Stack
+    {
+    public:
+        VStack() : Stack(false) {}
     };
 
     class Button : public Element
@@ -123,6 +352,15 @@ namespace retgui
         std::function<void()> m_onClicked;
     };
 
+    /* Styles the bytes [Begin, End) of a Label's text. */
+    struct TextSpan
+    {
+        std::size_t Begin{};
+        std::size_t End{};
+        Font* FontOverride{ nullptr };  // nullptr uses the Label's font
+        U32 ColorOverride{ 0 };         // 0 uses the Label's color
+    };
+
     class Label : public Element
     {
     public:
@@ -130,20 +368,302 @@ namespace retgui
         ~Label() = default;
 
         void render(DrawData& drawData) const override;
+        void on_atlas_rebuilt() override;
 
         auto get_font() const -> Font* { return m_font; }
         void set_font(Font* font);
 
         auto get_text() const -> const std::string& { return m_text; }
-        void set_text(const std::string& text);
+        void set_text(const std::string& text);  // UTF-8. Clears the spans.
+
+        /* Spans must not overlap. Text outside of every span uses the Label's font & color. */
+        auto get_spans() const -> const std::vector<TextSpan>& { return m_spans; }
+        void set_spans(const std::vector<TextSpan>& spans);
+        /* Appends text styled by a new span, eg. to build up a coloured status line. */
+        void add_text(const std::string& text, Font* font = nullptr, U32 color = 0);
+
+        /* Hit-testing. Offsets are in bytes into the text. O(log n) over the cached layout. */
+
+        /* Returns the offset of the character under a screen position, or std::string::npos if there is none. */
+        auto get_char_at(const Vec2& screenPos) const -> std::size_t;
+        /* Returns the character boundary closest to a screen position, eg. to start or extend a selection. */
+        auto get_caret_offset_at(const Vec2& screenPos) const -> std::size_t;
+        /* Returns the screen rect of the character at the offset, eg. to place a tooltip. */
+        auto get_char_bounds(std::size_t offset) const -> Rect;
 
     private:
         using Element::get_texture;
         using Element::set_texture;
 
+        auto measure() const -> Vec2 override;
+
+        void ensure_shaped() const;
+        void shape() const;
+        auto get_line_at(float y) const -> std::size_t;
+        auto get_line_of_offset(std::size_t offset) const -> std::size_t;
+        void render_greeked(DrawData& drawData, const Vec2& origin, U32 color, float greekingThreshold, TextGreeking greekingMode) const;
+
     private:
+        struct ShapedGlyph
+        {
+            Vec2 Min{};  // Relative to the Label's position
+            Vec2 Max{};
+            Vec2 UvMin{};
+            Vec2 UvMax{};
+            U32 Color{};  // 0 uses the Label's render color
+            U32 Page{};
+            float FontSize{};  // Of the glyph's font, to leave it to render_greeked() below the greeking threshold
+        };
+
+        struct ShapedLine
+        {
+            std::size_t Begin{};  // Byte offset into the text
+            float Top{};
+            float Height{};
+            float Baseline{};  // Relative to the Label's position, set once the line's tallest font is known
+            std::vector<float> CaretX{};      // Pen x before each character, plus the end of the line
+            std::vector<U32> CaretOffsets{};  // Byte offset of each CaretX, relative to Begin
+        };
+
         Font* m_font{ nullptr };
+        std::vector<TextSpan> m_spans{};
+
+        // Shaped once & re-emitted by every render() until the text, style or atlas changes.
+        mutable std::vector<ShapedGlyph> m_shapedGlyphs{};
+        mutable std::vector<ShapedLine> m_shapedLines{};
+        mutable bool m_shapeDirty{ true };
+        mutable U32 m_shapedAtlasGeneration{};
         std::string m_text{};
     };
 
+    struct TextCell
+    {
+        U32 CodePoint{ ' ' };
+        U32 Foreground{ RUIC_COL32_WHITE };
+        U32 Background{ 0 };  // Transparent
+    };
+
+    /*
+     * A fixed grid of cells over a monospaced font, eg. for terminals & log consoles.
+     * Every cell owns a background quad and a glyph quad at a fixed place in the DrawData, so writing N cells rewrites exactly those
+     * N cells' quads in place instead of re-rendering. Glyphs must be on the first atlas page.
+     */
+    class TextGrid : public Element
+    {
+    public:
+        TextGrid() = default;
+        ~TextGrid() = default;
+
+        void render(DrawData& drawData) const override;
+
+        auto get_font() const -> Font* { return m_font; }
+        void set_font(Font* font);
+
+        auto get_columns() const -> U32 { return m_columns; }
+        auto get_rows() const -> U32 { return m_rows; }
+        void set_grid_size(U32 columns, U32 rows);
+
+        auto get_cell_size() const -> Vec2;
+
+        /* Cells outside the grid read as empty cells, and writes to them are ignored. */
+        auto get_cell(U32 column, U32 row) const -> const TextCell&;
+        void set_cell(U32 column, U32 row, const TextCell& cell);
+
+        /* Writes UTF-8 text into consecutive cells of a row, clipped at the end of the row. */
+        void write_text(U32 column, U32 row, const std::string& text, U32 foreground, U32 background);
+        void clear_cells(const TextCell& cell = {});
+
+    private:
+        bool can_patch() const;
+        void write_cell_quads(DrawData& drawData, U32 cellIdx) const;
+
+    private:
+        using Element::get_texture;
+        using Element::set_texture;
+
+    private:
+        Font* m_font{ nullptr };
+        U32 m_columns{};
+        U32 m_rows{};
+        std::vector<TextCell> m_cells{};
+
+        // Where the cell quads were placed by the last render: background quads first, then glyph quads.
+        mutable U32 m_quadOffset{};
+        mutable U32 m_renderGeneration{};
+        mutable Vec2 m_renderOrigin{};
+    };
+
+    /*
+     * Read-only view over large, append-only UTF-8 text (eg. a log being tailed).
+     * Text is stored in fixed-size chunks so appends never move existing bytes, and a line-offset index
+     * lets scrolling jump to any line without scanning. Only the visible lines are drawn.
+     */
+    class LogView : public Element
+    {
+    public:
+        LogView() = default;
+        ~LogView() = default;
+
+        void render(DrawData& drawData) const override;
+
+        auto get_font() const -> Font* { return m_font; }
+        void set_font(Font* font);
+
+        /* Appends UTF-8 text. Amortised O(length). */
+        void append(const char* text, std::size_t length);
+        void append(const std::string& text);
+
+        /*
+         * Views text owned by the caller instead of copying it, eg. a memory-mapped file.
+         * The memory must stay valid until it is replaced or the view is cleared. Appending afterwards throws.
+         */
+        void set_external_text(const char* text, std::size_t length);
+        void clear();
+
+        auto get_size_bytes() const -> std::uint64_t { return m_size; }
+        auto get_line_count() const -> std::size_t { return m_lineOffsets.size(); }
+        /* Returns the line without its line break, or an empty string if it is past the end. */
+        auto get_line(std::size_t line) const -> std::string;
+        /* Returns the line containing the byte offset. O(log lines). */
+        auto get_line_at_offset(std::uint64_t offset) const -> std::size_t;
+        auto get_visible_line_count() const -> std::size_t;
+
+        auto get_scroll_line() const -> std::size_t { return m_scrollLine; }
+        /* Sets the first visible line. */
+        void set_scroll_line(std::size_t line);
+        void scroll_to_offset(std::uint64_t offset);
+
+        auto get_follow_tail() const -> bool { return m_followTail; }
+        /* Keeps the last line in view as text is appended. */
+        void set_follow_tail(bool followTail);
+
+    private:
+        void get_line_range(std::size_t line, std::uint64_t& outBegin, std::uint64_t& outEnd) const;
+        /* Returns a pointer to [offset, offset + length). Copies into scratch only if the range straddles chunks. */
+        auto get_bytes(std::uint64_t offset, std::uint64_t length, std::string& scratch) const -> const char*;
+        auto get_max_scroll_line() const -> std::size_t;
+        bool is_line_visible(std::size_t line) const;
+
+    private:
+        using Element::get_texture;
+        using Element::set_texture;
+
+    private:
+        static constexpr std::size_t ChunkSize = 64 * 1024;
+
+        Font* m_font{ nullptr };
+        std::vector<std::unique_ptr<char[]>> m_chunks{};
+        const char* m_externalText{ nullptr };
+        std::uint64_t m_size{ 0 };
+        std::vector<std::uint64_t> m_lineOffsets{ 0 };  // Byte offset each line starts at
+        std::size_t m_scrollLine{ 0 };
+        bool m_followTail{ true };
+        mutable std::string m_scratch{};
+    };
+
+    /*
+     * Editable multi-line UTF-8 text. Clicking gives it focus, then it takes input from IO::inputEvents.
+     * Lines are shaped once and cached, so an edit only reshapes the lines it touches and, where the lines still fit
+     * the vertex slots reserved by the last render(), patches them in place instead of re-rendering everything.
+     * Like TextGrid, only glyphs on the first atlas page are drawn.
+     */
+    class TextBox : public Element
+    {
+    public:
+        TextBox();
+        ~TextBox() = default;
+
+        void render(DrawData& drawData) const override;
+
+        auto get_font() const -> Font* { return m_font; }
+        void set_font(Font* font);
+
+        auto get_text() const -> std::string { return m_buffer.str(); }
+        void set_text(const std::string& text);
+
+        /* Offsets are in bytes and always on a UTF-8 character boundary. */
+        auto get_caret() const -> std::size_t { return m_caret; }
+        void set_caret(std::size_t offset, bool extendSelection = false);
+
+        bool has_selection() const { return m_caret != m_selectionAnchor; }
+        auto get_selection_begin() const -> std::size_t { return std::min(m_caret, m_selectionAnchor); }
+        auto get_selection_end() const -> std::size_t { return std::max(m_caret, m_selectionAnchor); }
+        void set_selection(std::size_t anchor, std::size_t caret);
+
+        /* Replaces the selection (if any) with the text, leaving the caret after it. */
+        void insert_text(const std::string& text);
+        void erase_selection();
+
+        /* Returns the caret offset closest to a screen position. */
+        auto get_offset_at(const Vec2& screenPos) const -> std::size_t;
+
+        auto get_caret_color() const -> U32 { return m_caretColor; }
+        void set_caret_color(U32 color);
+        auto get_selection_color() const -> U32 { return m_selectionColor; }
+        void set_selection_color(U32 color);
+
+        void on_mouse_button_down(int button) override;
+        void on_key_pressed(Key key) override;
+        void on_text_input(U32 character) override;
+
+    private:
+        struct ShapedGlyph
+        {
+            Vec2 Min{};  // Relative to the start of the line
+            Vec2 Max{};
+            Vec2 UvMin{};
+            Vec2 UvMax{};
+        };
+
+        struct TextLine
+        {
+            std::size_t Begin{};  // Byte offset into the buffer
+            std::size_t Length{};  // In bytes, excluding the '\n'
+            std::vector<ShapedGlyph> Glyphs{};
+            std::vector<float> CaretX{};  // X of each caret stop, relative to the start of the line
+            std::vector<U32> CaretOffsets{};  // Byte offset of each caret stop, relative to Begin
+
+            mutable U32 QuadOffset{};  // Slots reserved by the last render()
+            mutable U32 GlyphCapacity{};
+        };
+
+        void replace(std::size_t begin, std::size_t end, const std::string& text);
+        /* Reshapes every line if the atlas was rebuilt since they were shaped, as their glyph UVs are stale then. */
+        void ensure_shaped() const;
+        void shape_line(TextLine& line) const;
+        void shape_all_lines();
+
+        auto get_line_index(std::size_t offset) const -> std::size_t;
+        auto get_caret_stop(const TextLine& line, std::size_t offset) const -> std::size_t;
+        auto get_offset_in_line(const TextLine& line, float x) const -> std::size_t;
+        auto get_prev_offset(std::size_t offset) const -> std::size_t;
+        auto get_next_offset(std::size_t offset) const -> std::size_t;
+        void move_caret_line(int direction, bool extendSelection);
+
+        bool can_patch() const;
+        /* Rewrites the caret and the selection quads of the old & new selection's lines, or marks dirty if it can't. */
+        void patch_caret_and_selection(std::size_t oldFirstLine, std::size_t oldLastLine);
+        void write_line_quads(DrawData& drawData, std::size_t lineIdx) const;
+        void write_selection_quad(DrawData& drawData, std::size_t lineIdx) const;
+        void write_caret_quad(DrawData& drawData) const;
+
+    private:
+        using Element::get_texture;
+        using Element::set_texture;
+
+    private:
+        Font* m_font{ nullptr };
+        GapBuffer m_buffer{};
+        mutable std::vector<TextLine> m_lines{ TextLine{} };
+        mutable U32 m_shapedAtlasGeneration{};
+        std::size_t m_caret{ 0 };
+        std::size_t m_selectionAnchor{ 0 };
+        U32 m_caretColor{ RUIC_COL32_WHITE };
+        U32 m_selectionColor{ RETGUI_COL32(51, 102, 204, 128) };
+
+        mutable U32 m_caretQuadIdx{};
+        mutable U32 m_renderGeneration{};
+        mutable Vec2 m_renderOrigin{};
+    };
+
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include <string>
 #include <memory>
+#include <future>
 #include <filesystem>
 #include <unordered_map>
 
@@ -17,6 +18,35 @@ namespace retgui
         std::int32_t End;
     };
 
+    /*
+     * Collects the codepoints that are actually used (eg. from a corpus of UI strings or a localization file) and turns them
+     * into the smallest set of CharsetRanges, so the atlas only contains glyphs that can be drawn.
+     */
+    class CharsetBuilder
+    {
+    public:
+        void add_char(U32 codePoint);
+        void add_text(const std::string& text);  // UTF-8
+        void add_ranges(const std::vector<CharsetRange>& charsetRanges);
+
+        bool contains(U32 codePoint) const;
+        bool empty() const;
+
+        auto build_ranges() const -> std::vector<CharsetRange>;
+        void clear();
+
+    private:
+        std::vector<U32> m_usedChars{};  // One bit per codepoint, grown on demand.
+    };
+
+    /* A font to be loaded by Fonts::add_fonts_async(). */
+    struct FontRequest
+    {
+        std::string Filename{};
+        float FontSize{};
+        std::vector<CharsetRange> CharsetRanges{};
+    };
+
     /* A structure that describes a glyph. */
     struct GlyphMetrics
     {
@@ -32,6 +62,39 @@ namespace retgui
         float uy1;
         // The distance from the origin to the origin of the next glyph. This is usually a value > 0.
         float AdvanceX;
+        // Index of the atlas page that holds this glyph.
+        U32 Page;
+    };
+
+    /* A glyph of a prebaked font, with its position in the font's own alpha8 bitmap. */
+    struct BakedGlyph
+    {
+        U32 CodePoint;
+        // Bounding Box (around the origin)
+        I32 x0;
+        I32 y0;
+        I32 x1;
+        I32 y1;
+        float AdvanceX;
+        // Top-left of the glyph in the baked bitmap
+        U32 X;
+        U32 Y;
+    };
+
+    /* A prebaked font compiled into the executable as constant data (see retgui_fontc). */
+    struct EmbeddedFont
+    {
+        float FontSize;
+        float Ascender;
+        float Descender;
+        float LineSpacing;
+        float LineGap;
+        float MaxAdvanceWidth;
+        const BakedGlyph* Glyphs;
+        U32 GlyphCount;
+        const U8* Pixels;  // Alpha8, top row first.
+        U32 Width;
+        U32 Height;
     };
 
     struct Font
@@ -53,7 +116,13 @@ namespace retgui
             return &glyphs[codePoint];
         }
 
-        auto calc_text_size(const std::string& text) -> Vec2;
+        auto calc_text_size(const std::string& text) const -> Vec2;  // UTF-8
+    };
+
+    struct AsyncFontBuild
+    {
+        std::vector<Font*> Fonts{};      // Placeholders, in the same order as the requests.
+        std::shared_future<void> Ready{};  // Becomes ready once the worker has finished (or failed).
     };
 
     class Fonts
@@ -61,28 +130,94 @@ namespace retgui
     public:
         auto add_font_from_file(const std::string& fontFilename, float fontSize, std::vector<CharsetRange> charsetRanges = {}) -> Font*;
 
-        /* Build & Retrieve atlas. */
-        void get_texture_data_as_alpha8(std::vector<U8>& outPixels, U32& outWidth, U32& outHeight);
-        void get_texture_data_as_rgba32(std::vector<U32>& outPixels, U32& outWidth, U32& outHeight);
+        /*
+         * Loads a font that was prebaked with save_baked_font(). Its glyphs are copied into the atlas as they are, so no font
+         * parsing or rasterization happens at runtime.
+         */
+        auto add_font_from_baked_file(const std::string& bakedFilename) -> Font*;
+        void save_baked_font(const Font* font, const std::string& bakedFilename) const;
+
+        /* Registers a font generated by retgui_fontc. Its glyph table & pixels are referenced, not copied, so must outlive the atlas. */
+        auto add_font_from_embedded(const EmbeddedFont& embeddedFont) -> Font*;
+
+        /* Rasterizes all loaded glyphs of a font into its own alpha8 bitmap, as stored by baked & embedded fonts. */
+        void bake_font(const Font* font, std::vector<BakedGlyph>& outGlyphs, std::vector<U8>& outPixels, U32& outWidth, U32& outHeight) const;
+
+        /*
+         * Adds glyphs to an already loaded font at runtime. Returns TRUE if any new glyph was added, in which case the atlas must
+         * be rebuilt & re-uploaded through get_texture_data_as_*().
+         */
+        bool add_glyphs(Font* font, const std::vector<CharsetRange>& charsetRanges);
+        bool is_atlas_dirty() const { return m_atlasDirty; }
+        /* Incremented each time the atlas is (re)built, so cached glyph UVs can tell they are stale. */
+        auto get_atlas_generation() const -> U32 { return m_atlasGeneration; }
+
+        /*
+         * Loads the fonts and builds their atlas on a worker thread. The returned fonts are placeholders without glyphs (Labels
+         * draw them as blocks using the white pixel) until apply_async_build() installs the result.
+         */
+        auto add_fonts_async(const std::vector<FontRequest>& requests) -> AsyncFontBuild;
+        bool is_async_build_ready() const;
 
-        auto get_tex_id() const -> TexId { return m_texture; }
-        void set_tex_id(TexId texture);
+        /*
+         * Installs a finished async build into its placeholder fonts. The worker's atlas pages are appended after the existing ones,
+         * so only the new pages need to be uploaded; the next full rebuild packs all fonts together again.
+         * Returns FALSE if there is no finished build.
+         */
+        bool apply_async_build();
+
+        /* Build & Retrieve atlas. Glyphs that do not fit into one page of the maximum size spill into additional pages. */
+        void get_texture_data_as_alpha8(std::vector<U8>& outPixels, U32& outWidth, U32& outHeight, U32 page = 0);
+        void get_texture_data_as_rgba32(std::vector<U32>& outPixels, U32& outWidth, U32& outHeight, U32 page = 0);
+
+        auto get_page_count() const -> U32 { return U32(m_pages.size()); }  // Valid once the atlas has been built.
+        auto get_max_page_size() const -> U32 { return m_maxPageSize; }
+        void set_max_page_size(U32 maxPageSize);
+
+        auto get_tex_id(U32 page = 0) const -> TexId;
+        void set_tex_id(TexId texture, U32 page = 0);
 
         auto get_white_pixel_coords() const -> const Vec2& { return m_whitePixelCoords; }
 
+    private:
+        auto get_font_index(const Font* font) const -> I32;
+        bool load_glyphs(U32 fontIdx, const std::vector<CharsetRange>& charsetRanges);
+        void build_atlas();
+        auto add_baked_font(std::unique_ptr<Font> font, const EmbeddedFont& bakedFont) -> Font*;
+
     private:
         std::vector<std::unique_ptr<Font>> m_fonts{};
-        TexId m_texture{};
         Vec2 m_whitePixelCoords{};
 
-        struct FontCharToPack
+        struct AtlasPage
         {
-            U32 FontIdx{};
-            U32 CodePoint{};
-            std::uint8_t* Bitmap{ nullptr };
-            I32 Width{};
-            I32 Height{};
+            std::vector<U8> Pixels{};
+            U32 Width{};
+            U32 Height{};
+            TexId Texture{};
         };
-        std::vector<FontCharToPack> m_fontCharsToPack;
+        std::vector<AtlasPage> m_pages{};
+        U32 m_maxPageSize{ 4096 };
+
+        /* Kept for each font so its glyphs can be rasterized whenever the atlas is (re-)built. */
+        struct FontSource
+        {
+            std::vector<U8> Data{};  // Font file data, empty for prebaked fonts.
+            float Scale{};
+            CharsetBuilder LoadedChars{};
+
+            // Prebaked fonts. Points into the owned vectors when loaded from a file, or at the embedded constant data.
+            EmbeddedFont Baked{};
+            std::vector<BakedGlyph> OwnedBakedGlyphs{};
+            std::vector<U8> OwnedBakedPixels{};
+        };
+        std::vector<FontSource> m_fontSources{};
+        bool m_atlasBuilt{ false };
+        bool m_atlasDirty{ false };
+        U32 m_atlasGeneration{ 0 };
+
+        std::future<std::unique_ptr<Fonts>> m_asyncBuild{};
+        std::shared_future<void> m_asyncReady{};  // The AsyncFontBuild::Ready of m_asyncBuild
+        std::vector<Font*> m_asyncFonts{};
     };
 }
\ No newline at end of file
@@ -17,7 +17,28 @@ namespace retgui
 
         Element* hoveredElement{ nullptr };
         Element* activeElement{ nullptr };
+        Element* focusedElement{ nullptr };  // Receives IO::inputEvents
 
         DrawData drawData{};
+        DrawOutput drawOutput{ DrawOutput::Vertices };
+        bool drawBatching{ false };  // Run DrawData::batch_draw_cmds() after every full render()
+        U32 renderedAtlasGeneration{};  // Font atlas generation of the last full render(), to tell elements when it was rebuilt.
+        U32 drawDataGeneration{};      // Incremented by every full render(), so elements can tell if their vertices are still in drawData.
+        bool drawDataPatched{ false };  // Vertices were updated in place since the last render().
+
+        // drawData keeps its memory between renders. It is only released once drawDataShrinkFrames renders in a row used less than
+        // drawDataShrinkThreshold of it, and then only down to the most any of those renders needed.
+        U32 drawDataShrinkFrames{ 120 };
+        float drawDataShrinkThreshold{ 0.25f };
+        U32 drawDataFramesBelowThreshold{};
+        DrawData::Usage drawDataPeakUsage{};
+
+        // Text with a font size below this (in pixels) is unreadable, so it is drawn as solid bars instead of glyphs.
+        float greekingThreshold{ 4.0f };
+        TextGreeking greekingMode{ TextGreeking::Word };
+
+        CharsetBuilder* charsetRecorder{ nullptr };  // If set, the text of every Label::set_text() call is recorded into it.
+
+        std::vector<std::weak_ptr<const Element>> pendingArranges{};  // Layout containers whose children must be re-arranged
     };
 }
\ No newline at end of file
@@ -4,13 +4,41 @@
 #include "fonts.hpp"
 
 #include <array>
+#include <vector>
 
 namespace retgui
 {
+    enum class Key : U8
+    {
+        None,
+        Left,
+        Right,
+        Up,
+        Down,
+        Home,
+        End,
+        Backspace,
+        Delete,
+        Enter,
+    };
+
+    /* Either a key press (including repeats) or, if PressedKey is None, a typed character. */
+    struct InputEvent
+    {
+        Key PressedKey{ Key::None };
+        U32 Character{};
+    };
+
     struct IO
     {
         Fonts Fonts{};
         Vec2 cursorPos{};
         std::array<bool, 8> mouseBtns{};
+
+        bool keyShift{};
+        std::vector<InputEvent> inputEvents{};  // Sent to the focused element by update(), then cleared.
+
+        void add_key_pressed(Key key);
+        void add_input_character(U32 character);
     };
 }
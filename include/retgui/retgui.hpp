@@ -36,6 +36,11 @@ namespace retgui
 
     void set_dirty();
 
+    void set_draw_output(DrawOutput output);  // DrawOutput::Vertices by default
+    void set_draw_batching(bool enabled);     // Merges draw commands by texture where painter's order allows. Off by default
+    // Draw data memory is released after `frames` full renders in a row that used less than `threshold` (0-1) of it.
+    void set_draw_data_shrink_policy(std::uint32_t frames, float threshold);
+
     void update();
 
     bool render();  // Returns TRUE if render data changed
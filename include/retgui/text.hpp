@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace retgui
+{
+    /*
+     * Byte buffer with a movable gap at the edit position, so repeated inserts/erases near the same place are O(1) amortised
+     * instead of shifting the rest of the text every time.
+     */
+    class GapBuffer
+    {
+    public:
+        GapBuffer() = default;
+        explicit GapBuffer(const std::string& text);
+        ~GapBuffer() = default;
+
+        auto size() const -> std::size_t { return m_buffer.size() - (m_gapEnd - m_gapBegin); }
+        bool empty() const { return size() == 0; }
+
+        auto operator[](std::size_t pos) const -> char { return pos < m_gapBegin ? m_buffer[pos] : m_buffer[pos + (m_gapEnd - m_gapBegin)]; }
+
+        void insert(std::size_t pos, const char* text, std::size_t length);
+        void erase(std::size_t pos, std::size_t length);
+
+        auto substr(std::size_t pos, std::size_t length) const -> std::string;
+        auto str() const -> std::string;
+
+        void assign(const std::string& text);
+        void clear();
+
+    private:
+        void move_gap(std::size_t pos);
+        void grow_gap(std::size_t minLength);
+
+    private:
+        std::vector<char> m_buffer{};
+        std::size_t m_gapBegin{ 0 };
+        std::size_t m_gapEnd{ 0 };
+    };
+}
@@ -2,18 +2,33 @@
 
 #include <cmath>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 
 namespace retgui
 {
+    using I16 = std::int16_t;
     using I32 = std::int32_t;
 
     using U8 = std::uint8_t;
+    using U16 = std::uint16_t;
     using U32 = std::uint32_t;
 
     using TexId = std::uint64_t;
 
+    /*
+     * Define RETGUI_USE_16BIT_INDICES (the CMake option of the same name) to halve the index buffer. Commands are then chunked so
+     * none references more than 65536 vertices.
+     */
+#ifdef RETGUI_USE_16BIT_INDICES
+    using DrawIdx = U16;
+#else
     using DrawIdx = U32;
+#endif
+#define RETGUI_DRAW_IDX_MAX_VERTICES (std::size_t(DrawIdx(~DrawIdx(0))) + 1)
+#define RETGUI_DRAW_BATCH_LOOKBACK 32  // How many batches DrawData::batch_draw_cmds() looks back for one of the same texture
+
+    struct Font;
 
 #define RETGUI_COL32_R_SHIFT 0u
 #define RETGUI_COL32_G_SHIFT 8u
@@ -26,6 +41,39 @@ namespace retgui
 
     auto ColorToUInt32(float r, float g, float b, float a) -> U32;
 
+#define RETGUI_UNICODE_CODEPOINT_INVALID 0xFFFDu
+#define RETGUI_UNICODE_CODEPOINT_MAX 0x10FFFFu
+
+    /* Decodes one UTF-8 character. Returns the number of bytes consumed (always >= 1 while text < textEnd). */
+    auto utf8_decode(const char* text, const char* textEnd, U32& outCodePoint) -> I32;
+
+    /* Encodes one character as UTF-8 into outText (at least 4 bytes). Returns the number of bytes written. */
+    auto utf8_encode(U32 codePoint, char* outText) -> I32;
+
+    /* Returns the number of leading ASCII bytes. Scans 16 bytes at a time where SIMD is available. */
+    auto utf8_ascii_run_length(const char* text, const char* textEnd) -> std::size_t;
+
+    /* Calls fn(codePoint) for each character of UTF-8 text. Runs of ASCII skip the multi-byte decoder. */
+    template <typename Fn>
+    void utf8_for_each(const char* text, const char* textEnd, Fn&& fn)
+    {
+        while (text < textEnd)
+        {
+            const char* asciiEnd = text + utf8_ascii_run_length(text, textEnd);
+            for (; text < asciiEnd; ++text)
+            {
+                fn(U32(U8(*text)));
+            }
+
+            if (text < textEnd)
+            {
+                U32 codePoint{};
+                text += utf8_decode(text, textEnd, codePoint);
+                fn(codePoint);
+            }
+        }
+    }
+
     struct Color
     {
         float r;
@@ -89,6 +137,13 @@ namespace retgui
         auto height() const -> float { return br.y - tl.y; }
     };
 
+    /* How text below the greeking threshold is drawn. */
+    enum class TextGreeking
+    {
+        Word,  // One bar per word
+        Line,  // One bar per line
+    };
+
     /*
      * Used for positioning and sizing of Elements
      * Inspired by CEGUI.
@@ -143,18 +198,207 @@ namespace retgui
         bool operator!=(const Dim2& rhs) const;
     };
 
+#define RETGUI_DIM_EXPR_MAX_STACK_DEPTH 16
+
+    /*
+     * A dimension combining Dims with +, -, min, max & clamp, eg. DimExpr::max_of(Dim(0.5f, 0), Dim(0, 200)) for "half the
+     * parent, but at least 200px". Built once into a flat postfix program that evaluate() runs over a small fixed stack
+     * without allocating. Sums of plain Dims fold into a single Dim, which evaluates the same as a Dim does.
+     */
+    class DimExpr
+    {
+    public:
+        DimExpr() = default;
+        DimExpr(const Dim& dim);  // NOLINT: Implicit so Dims can be used directly
+
+        static auto min_of(const DimExpr& a, const DimExpr& b) -> DimExpr;
+        static auto max_of(const DimExpr& a, const DimExpr& b) -> DimExpr;
+        static auto clamp(const DimExpr& value, const DimExpr& min, const DimExpr& max) -> DimExpr;
+
+        auto operator+(const DimExpr& rhs) const -> DimExpr;
+        auto operator-(const DimExpr& rhs) const -> DimExpr;
+
+        auto evaluate(float parentSize) const -> float
+        {
+            if (m_program.size() == 1)
+            {
+                return m_program[0].Term.scale * parentSize + m_program[0].Term.offset;
+            }
+            return evaluate_program(parentSize);
+        }
+
+        bool is_single_term() const { return m_program.size() == 1; }
+        bool depends_on_parent() const;
+
+    private:
+        enum class OpCode : U8
+        {
+            Push,  // Pushes Term evaluated against the parent size
+            Add,
+            Sub,
+            Min,
+            Max,
+        };
+
+        struct Instruction
+        {
+            OpCode Op{ OpCode::Push };
+            Dim Term{};
+        };
+
+        static auto combine(const DimExpr& a, const DimExpr& b, OpCode op) -> DimExpr;
+        auto evaluate_program(float parentSize) const -> float;
+
+    private:
+        std::vector<Instruction> m_program{};
+        U32 m_stackDepth{ 0 };
+    };
+
+    struct DimExpr2
+    {
+        DimExpr x{};
+        DimExpr y{};
+    };
+
+    /*
+     * Define RETGUI_TEXTURE_SLOTS (the CMake cache variable of the same name) to the number of textures the backend can bind at
+     * once (eg. 8) to let one command draw with that many. Every vertex & quad then carries the slot of its texture in
+     * DrawCmd::Textures, and commands only split once more textures are used than there are slots. The slot pads DrawVert to
+     * 24 bytes (16 if compact) and DrawQuad to 40.
+     */
+#ifdef RETGUI_TEXTURE_SLOTS
+    static_assert(RETGUI_TEXTURE_SLOTS >= 1 && RETGUI_TEXTURE_SLOTS <= 256, "RETGUI_TEXTURE_SLOTS must fit a U8 slot index");
+#endif
+
+    /*
+     * Define RETGUI_USE_COMPACT_VERTICES (the CMake option of the same name) for 12 byte vertices (16 with RETGUI_TEXTURE_SLOTS):
+     * positions as int16 pixels (rounded) and UVs as unorm16.
+     * The backend then has to read pos as non-normalized shorts and uv as normalized unsigned shorts.
+     */
+#ifdef RETGUI_USE_COMPACT_VERTICES
+    struct DrawVert
+    {
+        I16 pos[2]{};
+        U16 uv[2]{};
+        std::uint32_t col{};
+#ifdef RETGUI_TEXTURE_SLOTS
+        U8 slot{};
+#endif
+
+        static auto pack(const Vec2& pos, const Vec2& uv, std::uint32_t col) -> DrawVert
+        {
+            return { { pack_pos(pos.x), pack_pos(pos.y) }, { pack_uv(uv.x), pack_uv(uv.y) }, col };
+        }
+
+        auto get_pos() const -> Vec2 { return { float(pos[0]), float(pos[1]) }; }
+
+    private:
+        static auto pack_pos(float v) -> I16 { return I16(std::fmin(std::fmax(std::roundf(v), -32768.0f), 32767.0f)); }
+        static auto pack_uv(float v) -> U16 { return U16(std::roundf(std::fmin(std::fmax(v, 0.0f), 1.0f) * 65535.0f)); }
+    };
+#else
     struct DrawVert
     {
         Vec2 pos{};
         Vec2 uv{};
         std::uint32_t col{};
+#ifdef RETGUI_TEXTURE_SLOTS
+        U8 slot{};
+#endif
+
+        static auto pack(const Vec2& pos, const Vec2& uv, std::uint32_t col) -> DrawVert { return { pos, uv, col }; }
+
+        auto get_pos() const -> Vec2 { return pos; }
+    };
+#endif
+
+    /* A whole textured rect, for DrawOutput::Quads. 36 bytes instead of the 4 DrawVerts + 6 DrawIdx (104 bytes) of a vertex quad. */
+    struct DrawQuad
+    {
+        Vec2 Min{};
+        Vec2 Max{};
+        Vec2 UvMin{};
+        Vec2 UvMax{};
+        std::uint32_t Col{};
+#ifdef RETGUI_TEXTURE_SLOTS
+        U8 Slot{};
+#endif
+    };
+
+    /* How DrawData stores primitives. Everything retgui draws is a quad. */
+    enum class DrawOutput : U8
+    {
+        Vertices,  // VertexBuffer & IndexBuffer
+        Quads,     // QuadBuffer, for backends that expand quads with instancing or a shared static index pattern
     };
 
     struct DrawCmd
     {
         TexId TextureId{};
-        U32 IndexOffset{};
+        U32 IndexOffset{};  // DrawOutput::Vertices
         U32 IndexCount{};
+        U32 QuadOffset{};  // Both outputs
+        U32 QuadCount{};
+        U32 VertexOffset{};  // DrawOutput::Vertices, the indices are relative to it
+        U32 LayerIdx{};      // Into DrawData::Layers
+#ifdef RETGUI_TEXTURE_SLOTS
+        TexId Textures[RETGUI_TEXTURE_SLOTS]{};  // Indexed by the slot of each vertex/quad. TextureId is the first one
+        U32 TextureCount{};
+#endif
+    };
+
+    /*
+     * Translation & opacity the backend applies to every command of a layer (see Element::set_layer_root()), so a layer can be
+     * moved or faded by patching these values instead of its vertices. Layer 0 is the identity.
+     */
+    struct DrawLayer
+    {
+        Vec2 Translation{};  // Including the parent layers
+        float Opacity{ 1.0f };
+        U32 Parent{};
+        Vec2 LocalTranslation{};
+        float LocalOpacity{ 1.0f };
+    };
+
+    /*
+     * Raw cursors over quads from DrawData::add_quads() or reserve_quads(), for elements that emit many quads in a tight loop.
+     * Writes are unchecked: index i must be below the reserved count, and the cursors are invalidated by the next add to DrawData.
+     */
+    struct QuadWriter
+    {
+        DrawVert* Vertices{};  // DrawOutput::Vertices, 4 per quad
+        DrawQuad* Quads{};     // DrawOutput::Quads
+        Vec2 WhitePixelUv{};
+        U32 FirstQuad{};  // Quad index of the first reserved quad, for patching later with DrawData::write_textured_rect()
+#ifdef RETGUI_TEXTURE_SLOTS
+        U8 Slot{};  // Of the texture the quads are drawn with
+#endif
+
+        void write_textured_rect(U32 i, const Vec2& min, const Vec2& max, std::uint32_t color, const Vec2& uvMin, const Vec2& uvMax) const
+        {
+            if (Quads != nullptr)
+            {
+                Quads[i] = DrawQuad{ min, max, uvMin, uvMax, color };
+#ifdef RETGUI_TEXTURE_SLOTS
+                Quads[i].Slot = Slot;
+#endif
+                return;
+            }
+
+            auto* vertices = Vertices + std::size_t(i) * 4;
+            vertices[0] = DrawVert::pack(min, uvMin, color);                              // TL
+            vertices[1] = DrawVert::pack({ min.x, max.y }, { uvMin.x, uvMax.y }, color);  // BL
+            vertices[2] = DrawVert::pack(max, uvMax, color);                              // BR
+            vertices[3] = DrawVert::pack({ max.x, min.y }, { uvMax.x, uvMin.y }, color);  // TR
+#ifdef RETGUI_TEXTURE_SLOTS
+            vertices[0].slot = vertices[1].slot = vertices[2].slot = vertices[3].slot = Slot;
+#endif
+        }
+
+        void write_rect(U32 i, const Vec2& min, const Vec2& max, std::uint32_t color) const
+        {
+            write_textured_rect(i, min, max, color, WhitePixelUv, WhitePixelUv);
+        }
     };
 
     struct DrawData
@@ -162,11 +406,112 @@ namespace retgui
         std::vector<DrawCmd> DrawCmds{};
         std::vector<DrawVert> VertexBuffer{};
         std::vector<DrawIdx> IndexBuffer{};
+        std::vector<DrawQuad> QuadBuffer{};
+        DrawOutput Output{ DrawOutput::Vertices };
+        Vec2 WhitePixelUv{};  // Set by render(), so add_rect() doesn't have to look up the font atlas
+        std::vector<U32> QuadRemap{};  // Set by batch_draw_cmds(): where each quad, by the index it was added at, now is
+        std::vector<DrawLayer> Layers{ DrawLayer{} };
+
+        /* Element counts of the buffers, either in use or allocated. */
+        struct Usage
+        {
+            std::size_t DrawCmds{};
+            std::size_t Vertices{};
+            std::size_t Indices{};
+            std::size_t Quads{};
+
+            auto get_bytes() const -> std::size_t;
+        };
+
+        auto get_usage() const -> Usage;
+        auto get_capacity() const -> Usage;
+        /* Empties the buffers but keeps their memory, so a frame no bigger than the previous ones doesn't allocate. */
+        void clear();
+        /* Releases the memory of every buffer allocated beyond `keep`. */
+        void shrink(const Usage& keep);
 
         void add_draw_cmd(TexId texture);
+        /* Sets the counts of the last command. render() calls this once everything is drawn. */
+        void close_draw_cmd();
+
+        /* Quads are numbered the same in both outputs, so elements can patch them by index. */
+        auto get_quad_count() const -> U32 { return Output == DrawOutput::Quads ? U32(QuadBuffer.size()) : U32(VertexBuffer.size() / 4); }
 
         void add_line(const Vec2& a, const Vec2& b);
         void add_textured_rect(const Vec2& min, const Vec2& max, std::uint32_t color, const Vec2& uvMin, const Vec2& uvMax);
         void add_rect(const Vec2& min, const Vec2& max, std::uint32_t color);
+        /*
+         * Appends `count` zero-sized quads to the current command and returns cursors to fill them in place. The indices are written
+         * here. The quads are filled once, so batch_draw_cmds() can still move them like any other.
+         */
+        auto add_quads(U32 count) -> QuadWriter;
+        /* Like add_quads(), for quads that are rewritten later through write_textured_rect(), so batch_draw_cmds() leaves them be. */
+        auto reserve_quads(U32 count) -> QuadWriter;
+
+        /* Draws UTF-8 text with its top-left at pos. */
+        void add_text(const Font& font, const Vec2& pos, std::uint32_t color, const char* text, const char* textEnd);
+
+        /* Overwrites a rect that was previously added as the quadIdx'th quad. */
+        void write_textured_rect(U32 quadIdx, const Vec2& min, const Vec2& max, std::uint32_t color, const Vec2& uvMin, const Vec2& uvMax);
+
+        /* Starts a layer below the current one. What is added until pop_layer() is drawn with it. Returns its index. */
+        auto push_layer(const Vec2& translation, float opacity) -> U32;
+        void pop_layer();
+        /* Changes a layer after the fact, along with the layers below it. */
+        void set_layer_params(U32 layerIdx, const Vec2& translation, float opacity);
+
+        /* Starts a unit for batch_draw_cmds(): what is added until the next call is only moved as a whole. render() starts one per element. */
+        void begin_unit();
+        /*
+         * Regroups what was drawn by texture where that can't change the result: a unit is only moved in front of units it
+         * doesn't overlap, so painter's order holds wherever primitives overlap. Nothing moves past a unit that reserved quads,
+         * as those may still be rewritten. Quad indices from before stay valid for write_textured_rect() through QuadRemap.
+         * Layers can move independently, so nothing moves past a piece of another layer.
+         * Does nothing with RETGUI_TEXTURE_SLOTS, where commands already hold several textures.
+         */
+        void batch_draw_cmds();
+
+    private:
+        void set_current_layer(U32 layerIdx);
+
+        struct DrawUnit
+        {
+            U32 FirstQuad{};
+            bool Patchable{};  // Reserved quads with reserve_quads()
+        };
+
+        // The part of a unit drawn by one command, which is what batch_draw_cmds() moves.
+        struct DrawPiece
+        {
+            TexId Texture{};
+            U32 QuadOffset{};
+            U32 QuadCount{};
+            Rect Bounds{};
+            bool Patchable{};
+            U32 Layer{};
+            U32 NextInBatch{};
+        };
+
+        struct DrawBatch
+        {
+            TexId Texture{};
+            Rect Bounds{};
+            U32 FirstPiece{};
+            U32 LastPiece{};
+            U32 Layer{};
+            bool Barrier{};
+        };
+
+        std::vector<DrawUnit> m_units{};
+        U32 m_currentLayer{};
+#ifdef RETGUI_TEXTURE_SLOTS
+        U8 m_currentSlot{};  // Of the texture last passed to add_draw_cmd()
+#endif
+
+        // Scratch space of batch_draw_cmds(), kept to not allocate every render.
+        std::vector<DrawPiece> m_pieces{};
+        std::vector<DrawBatch> m_batches{};
+        std::vector<DrawVert> m_unbatchedVertices{};
+        std::vector<DrawQuad> m_unbatchedQuads{};
     };
 }
\ No newline at end of file
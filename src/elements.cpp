@@ -4,6 +4,10 @@
 #include "retgui/io.hpp"
 #include "retgui/internal.hpp"
 
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
 namespace retgui
 {
     void Element::update()
@@ -58,6 +62,25 @@ namespace retgui
                 }
             }
         }
+
+        if (m_enabledStates & RETGUI_ELEMENT_STATE_FOCUSED)
+        {
+            if (context->activeElement == this && !(m_state & RETGUI_ELEMENT_STATE_FOCUSED))
+            {
+                if (context->focusedElement != nullptr)
+                {
+                    context->focusedElement->remove_state(RETGUI_ELEMENT_STATE_FOCUSED);
+                }
+                context->focusedElement = this;
+                add_state(RETGUI_ELEMENT_STATE_FOCUSED);
+            }
+            else if ((m_state & RETGUI_ELEMENT_STATE_FOCUSED) && io.mouseBtns[0] && !is_cursor_inside())
+            {
+                // Clicked somewhere else
+                context->focusedElement = nullptr;
+                remove_state(RETGUI_ELEMENT_STATE_FOCUSED);
+            }
+        }
     }
 
     void Element::render(DrawData& drawData) const
@@ -66,7 +89,31 @@ namespace retgui
         const auto& color = get_render_color();
 
         drawData.add_draw_cmd(m_texture);
-        drawData.add_rect(bounds.tl, bounds.br, color.Int32());
+        if (m_texture != 0)
+        {
+            drawData.add_textured_rect(bounds.tl, bounds.br, color.Int32(), { 0.0f, 0.0f }, { 1.0f, 1.0f });
+        }
+        else
+        {
+            drawData.add_rect(bounds.tl, bounds.br, color.Int32());
+        }
+    }
+
+    void Element::begin_layer(DrawData& drawData) const
+    {
+        if (m_layerRoot)
+        {
+            m_layerIdx = drawData.push_layer(m_layerTranslation, m_layerOpacity);
+            m_layerGeneration = get_current_context()->drawDataGeneration;
+        }
+    }
+
+    void Element::end_layer(DrawData& drawData) const
+    {
+        if (m_layerRoot)
+        {
+            drawData.pop_layer();
+        }
     }
 
     auto Element::get_parent() const -> ElementBasePtr
@@ -108,7 +155,12 @@ namespace retgui
         element->m_prevSibling = m_lastChild;
         m_lastChild = element;
         element->m_parent = shared_from_this();
+        element->invalidate_layout(true, true);
 
+        if (arranges_children())
+        {
+            on_child_measure_invalidated(*element);
+        }
         set_dirty();
         return shared_from_this();
     }
@@ -131,6 +183,11 @@ namespace retgui
             return;
         }
 
+        if (arranges_children())
+        {
+            on_child_measure_invalidated(*childPtr);
+        }
+
         childPtr->m_parent = nullptr;
         if (childPtr->m_prevSibling)
         {
@@ -140,6 +197,18 @@ namespace retgui
         {
             childPtr->m_nextSibling->m_prevSibling = childPtr->m_prevSibling;
         }
+        if (m_firstChild == childPtr)
+        {
+            m_firstChild = childPtr->m_nextSibling;
+        }
+        if (m_lastChild == childPtr)
+        {
+            m_lastChild = childPtr->m_prevSibling;
+        }
+        childPtr->m_prevSibling = nullptr;
+        childPtr->m_nextSibling = nullptr;
+        childPtr->invalidate_layout(true, true);
+        on_child_removed(*childPtr);
 
         set_dirty();
     }
@@ -147,6 +216,25 @@ namespace retgui
     auto Element::set_position(const Dim2& position) -> ElementBasePtr
     {
         m_position = position;
+        m_positionExpr = nullptr;
+        invalidate_layout(true, false);
+        set_dirty();
+        return shared_from_this();
+    }
+
+    auto Element::set_position_expr(const DimExpr& x, const DimExpr& y) -> ElementBasePtr
+    {
+        m_positionExpr = std::make_unique<DimExpr2>(DimExpr2{ x, y });
+        invalidate_layout(true, false);
+        set_dirty();
+        return shared_from_this();
+    }
+
+    auto Element::set_size_expr(const DimExpr& x, const DimExpr& y) -> ElementBasePtr
+    {
+        m_sizeExpr = std::make_unique<DimExpr2>(DimExpr2{ x, y });
+        invalidate_layout(false, true);
+        invalidate_measure();
         set_dirty();
         return shared_from_this();
     }
@@ -154,32 +242,23 @@ namespace retgui
     auto Element::set_size(const Dim2& size) -> ElementBasePtr
     {
         m_size = size;
+        m_sizeExpr = nullptr;
+        invalidate_layout(false, true);
+        invalidate_measure();
         set_dirty();
         return shared_from_this();
     }
 
     auto Element::get_screen_position() const -> Vec2
     {
-        Vec2 pos = { m_position.x.offset, m_position.y.offset };
-        if (get_parent() != nullptr)
-        {
-            auto parentPos = get_parent()->get_screen_position();
-            pos += parentPos;
-            auto parentSize = get_parent()->get_screen_size();
-            pos += parentSize* Vec2{ m_position.x.scale, m_position.y.scale };
-        }
-        return pos;
+        update_layout();
+        return m_screenPos;
     }
 
     auto Element::get_screen_size() const -> Vec2
     {
-        Vec2 size = { m_size.x.offset, m_size.y.offset };
-        if (get_parent() != nullptr)
-        {
-            auto parentSize = get_parent()->get_screen_size();
-            size += parentSize* Vec2{ m_size.x.scale, m_size.y.scale };
-        }
-        return size;
+        update_layout();
+        return m_screenSize;
     }
 
     auto Element::get_bounds() const -> Rect
@@ -199,6 +278,68 @@ namespace retgui
         return shared_from_this();
     }
 
+    void Element::set_texture(TexId texture)
+    {
+        m_texture = texture;
+        set_dirty();
+    }
+
+    auto Element::set_layer_root(bool layerRoot) -> ElementBasePtr
+    {
+        if (m_layerRoot != layerRoot)
+        {
+            m_layerRoot = layerRoot;
+            set_dirty();
+        }
+        return shared_from_this();
+    }
+
+    auto Element::set_layer_translation(const Vec2& translation) -> ElementBasePtr
+    {
+        m_layerTranslation = translation;
+        patch_layer();
+        return shared_from_this();
+    }
+
+    auto Element::set_layer_opacity(float opacity) -> ElementBasePtr
+    {
+        m_layerOpacity = opacity;
+        patch_layer();
+        return shared_from_this();
+    }
+
+    auto Element::get_layer_offset() const -> Vec2
+    {
+        Vec2 offset{};
+        for (const auto* element = this; element != nullptr; element = element->m_parent.get())
+        {
+            if (element->m_layerRoot)
+            {
+                offset += element->m_layerTranslation;
+            }
+        }
+        return offset;
+    }
+
+    void Element::patch_layer()
+    {
+        if (!m_layerRoot)
+        {
+            return;  // Takes effect once this becomes a layer root
+        }
+
+        auto* context = get_current_context();
+        if (!context->dirty && m_layerGeneration == context->drawDataGeneration && m_layerGeneration != 0)
+        {
+            context->drawData.set_layer_params(m_layerIdx, m_layerTranslation, m_layerOpacity);
+            context->drawDataPatched = true;
+        }
+        else
+        {
+            set_dirty();
+        }
+    }
+
     auto Element::get_render_color() const -> const Color&
     {
         if (m_state & RETGUI_ELEMENT_STATE_ACTIVE)
@@ -221,7 +362,7 @@ namespace retgui
 
     void Element::add_state(U8 state)
     {
-        if (m_enabledStates & state)
+        if ((m_enabledStates & state) && (m_state & state) != state)
         {
             m_state |= state;
             set_dirty();
@@ -230,7 +371,7 @@ namespace retgui
 
     void Element::remove_state(U8 state)
     {
-        if (m_enabledStates & state)
+        if ((m_enabledStates & state) && (m_state & state) != 0)
         {
             m_state &= ~state;
             set_dirty();
@@ -240,7 +381,7 @@ namespace retgui
     bool Element::is_cursor_inside() const
     {
         auto& io = get_current_context()->io;
-        const auto cursorPos = io.cursorPos;
+        const auto cursorPos = io.cursorPos - get_layer_offset();
         const auto bb = get_bounds();
         return (cursorPos.x >= bb.tl.x && cursorPos.x <= bb.br.x) && (cursorPos.y >= bb.tl.y && cursorPos.y <= bb.br.y);
     }
@@ -264,79 +405,1729 @@ namespace retgui
         m_enabledStates = states;
     }
 
-    Button::Button()
+    auto Element::get_measured_size() const -> Vec2
     {
-        set_enabled_states(RETGUI_ELEMENT_STATE_HOVERED | RETGUI_ELEMENT_STATE_ACTIVE);
+        if (!m_measureValid)
+        {
+            m_measuredSize = measure();
+            m_measureValid = true;
+        }
+        return m_measuredSize;
     }
 
-    void Button::set_on_clicked(std::function<void()>&& callback)
+    void Element::invalidate_measure()
     {
-        m_onClicked = callback;
+        m_measureValid = false;
+        if (m_parent != nullptr && m_parent->arranges_children())
+        {
+            m_parent->on_child_measure_invalidated(*this);
+        }
+        set_dirty();
     }
 
-    void Button::on_mouse_button_up(int button)
+    auto Element::set_flex(float grow, float shrink) -> ElementBasePtr
     {
-        m_onClicked();
+        m_flexGrow = grow;
+        m_flexShrink = shrink;
+        if (m_parent != nullptr)
+        {
+            m_parent->invalidate_arrange();
+        }
+        return shared_from_this();
     }
 
-    Label::Label() = default;
+    auto Element::measure() const -> Vec2
+    {
+        if (m_sizeExpr != nullptr)
+        {
+            return { m_sizeExpr->x.evaluate(0.0f), m_sizeExpr->y.evaluate(0.0f) };
+        }
+        return { m_size.x.offset, m_size.y.offset };
+    }
 
-    void Label::render(DrawData& drawData) const
+    void Element::set_arranged_rect(const Element& child, const Rect& rect)
     {
-        auto& io = get_current_context()->io;
-        drawData.add_draw_cmd(io.Fonts.get_tex_id());
+        const auto& oldRect = child.m_arrangedRect;
+        const bool positionChanged = rect.tl.x != oldRect.tl.x || rect.tl.y != oldRect.tl.y;
+        const bool sizeChanged = rect.width() != oldRect.width() || rect.height() != oldRect.height();
+        child.m_arrangedRect = rect;
+        if (positionChanged || sizeChanged)
+        {
+            child.invalidate_layout(positionChanged, sizeChanged);
+        }
+    }
 
-        const auto screenPos = get_screen_position();
-        float x = screenPos.x;  // Align to be pixel perfect
-        float y = screenPos.y;  // Align to be pixel-perfect
+    void Element::invalidate_arrange()
+    {
+        if (m_arrangeValid)
+        {
+            // Children may hold cached rects from the old arrangement, so re-arrange before any rect is read again.
+            auto* context = get_current_context();
+            if (context != nullptr)
+            {
+                context->pendingArranges.push_back(weak_from_this());
+            }
+        }
+        m_arrangeValid = false;
+        set_dirty();
+    }
 
-        y += float(m_font->Ascender);
+    void Element::update_layout() const
+    {
+        auto* context = get_current_context();
+        if (context != nullptr && !context->pendingArranges.empty())
+        {
+            const auto pendingArranges = std::move(context->pendingArranges);
+            context->pendingArranges.clear();
+            for (const auto& weakElement : pendingArranges)
+            {
+                if (const auto element = weakElement.lock())
+                {
+                    element->ensure_arranged();
+                }
+            }
+        }
 
-        for (auto i = 0; i < m_text.size(); ++i)
+        if (m_layoutValid)
         {
-            char character = m_text[i];
-            if (character == '\n')
+            return;
+        }
+
+        if (m_parent != nullptr && m_parent->arranges_children())
+        {
+            m_parent->ensure_arranged();
+            m_screenPos = m_parent->get_screen_position() + m_arrangedRect.tl;
+            m_screenSize = m_arrangedRect.br - m_arrangedRect.tl;
+        }
+        else
+        {
+            const auto parentPos = m_parent != nullptr ? m_parent->get_screen_position() : Vec2{};
+            const auto parentSize = m_parent != nullptr ? m_parent->get_screen_size() : Vec2{};
+            if (m_positionExpr != nullptr)
+            {
+                m_screenPos = parentPos + Vec2{ m_positionExpr->x.evaluate(parentSize.x), m_positionExpr->y.evaluate(parentSize.y) };
+            }
+            else
+            {
+                m_screenPos = parentPos + Vec2{ m_position.x.offset, m_position.y.offset } + parentSize * Vec2{ m_position.x.scale, m_position.y.scale };
+            }
+            if (m_sizeExpr != nullptr)
+            {
+                m_screenSize = { m_sizeExpr->x.evaluate(parentSize.x), m_sizeExpr->y.evaluate(parentSize.y) };
+            }
+            else
             {
-                x = screenPos.x;
-                y += m_font->LineSpacing;
+                m_screenSize = Vec2{ m_size.x.offset, m_size.y.offset } + parentSize * Vec2{ m_size.x.scale, m_size.y.scale };
             }
+        }
+        m_layoutValid = true;
+    }
 
-            auto* glyph = m_font->get_glyph(U32(character));
-            if (glyph == nullptr)
+    void Element::invalidate_layout(bool positionChanged, bool sizeChanged) const
+    {
+        m_layoutValid = false;
+
+        // Only descend into children that depend on what changed. Pure pixel offset children keep their cached size, and
+        // with it their whole subtree when only our size changed.
+        const bool arranged = arranges_children();
+        for (auto* child = m_firstChild.get(); child != nullptr; child = child->m_nextSibling.get())
+        {
+            const bool scalesPosition = child->scales_position();
+            const bool scalesSize = child->scales_size();
+            const bool childPositionChanged = positionChanged || (sizeChanged && (arranged || scalesPosition));
+            const bool childSizeChanged = sizeChanged && (arranged || scalesSize);
+            if (childPositionChanged || childSizeChanged)
             {
-                glyph = m_font->get_glyph('?');
+                child->invalidate_layout(childPositionChanged, childSizeChanged);
             }
+        }
+    }
+
+    bool Element::scales_position() const
+    {
+        if (m_positionExpr != nullptr)
+        {
+            return m_positionExpr->x.depends_on_parent() || m_positionExpr->y.depends_on_parent();
+        }
+        return m_position.x.scale != 0.0f || m_position.y.scale != 0.0f;
+    }
+
+    bool Element::scales_size() const
+    {
+        if (m_sizeExpr != nullptr)
+        {
+            return m_sizeExpr->x.depends_on_parent() || m_sizeExpr->y.depends_on_parent();
+        }
+        return m_size.x.scale != 0.0f || m_size.y.scale != 0.0f;
+    }
+
+    void Element::on_child_measure_invalidated(const Element&)
+    {
+        invalidate_arrange();
+        invalidate_measure();  // Containers measure their children
+    }
+
+    void Element::ensure_arranged() const
+    {
+        const auto size = get_screen_size();
+        if (!m_arrangeValid || size.x != m_arrangedForSize.x || size.y != m_arrangedForSize.y)
+        {
+            arrange(size);
+            m_arrangeValid = true;
+            m_arrangedForSize = size;
+        }
+    }
+
+    void Grid::set_columns(const std::vector<GridTrack>& columns)
+    {
+        m_columns.Tracks = columns;
+        m_columns.ContentSizes.assign(columns.size(), 0.0f);
+        m_columns.ContentDirty.assign(columns.size(), true);
+        m_columns.ResolvedForSize = -1.0f;
+        m_contentDirty = true;
+        invalidate_measure();
+        invalidate_arrange();
+    }
+
+    void Grid::set_rows(const std::vector<GridTrack>& rows)
+    {
+        m_rows.Tracks = rows;
+        m_rows.ContentSizes.assign(rows.size(), 0.0f);
+        m_rows.ContentDirty.assign(rows.size(), true);
+        m_rows.ResolvedForSize = -1.0f;
+        m_contentDirty = true;
+        invalidate_measure();
+        invalidate_arrange();
+    }
+
+    void Grid::set_gap(const Vec2& gap)
+    {
+        m_gap = gap;
+        m_columns.ResolvedForSize = -1.0f;
+        m_rows.ResolvedForSize = -1.0f;
+        invalidate_measure();
+        invalidate_arrange();
+    }
+
+    auto Grid::add_child(const ElementBasePtr& element, U32 row, U32 column, U32 rowSpan, U32 columnSpan) -> ElementBasePtr
+    {
+        Element::add_child(element);
+        set_cell(element, row, column, rowSpan, columnSpan);
+        return shared_from_this();
+    }
+
+    void Grid::set_cell(const ElementBasePtr& element, U32 row, U32 column, U32 rowSpan, U32 columnSpan)
+    {
+        mark_tracks_dirty(get_cell(*element));
+        const GridCell cell = { row, column, std::max(rowSpan, 1u), std::max(columnSpan, 1u) };
+        m_cells[element.get()] = cell;
+        mark_tracks_dirty(cell);
+
+        invalidate_measure();
+        invalidate_arrange();
+    }
+
+    auto Grid::measure() const -> Vec2
+    {
+        update_content_sizes();
 
-            Vec2 quadTL = { std::roundf(x + glyph->x0), std::roundf(y + glyph->y0) };
-            Vec2 quadBR = { std::roundf(x + glyph->x1), std::roundf(y + glyph->y1) };
-            Vec2 uvMin = { glyph->ux0, glyph->uy0 };
-            Vec2 uvMax = { glyph->ux1, glyph->uy1 };
+        // Fraction tracks have no size of their own.
+        const auto measureTracks = [](const TrackList& trackList, float gap) {
+            float size = 0.0f;
+            for (std::size_t i = 0; i < trackList.Tracks.size(); ++i)
+            {
+                const auto& track = trackList.Tracks[i];
+                size += track.Type == GridTrackType::Fixed ? track.Value : track.Type == GridTrackType::Auto ? trackList.ContentSizes[i] : 0.0f;
+            }
+            return size + (trackList.Tracks.size() > 1 ? gap * float(trackList.Tracks.size() - 1) : 0.0f);
+        };
+        return { measureTracks(m_columns, m_gap.x), measureTracks(m_rows, m_gap.y) };
+    }
 
-            drawData.add_textured_rect(quadTL, quadBR, get_render_color().Int32(), uvMin, uvMax);
+    void Grid::arrange(const Vec2& size) const
+    {
+        update_content_sizes();
+        resolve_tracks(m_columns, size.x, m_gap.x);
+        resolve_tracks(m_rows, size.y, m_gap.y);
 
-            double advance = 0.0;
-            if (i < m_text.size() - 1)
+        for (auto child = get_first_child(); child != nullptr; child = child->get_next_sibling())
+        {
+            const auto cell = get_cell(*child);
+            if (m_columns.Tracks.empty() || m_rows.Tracks.empty())
             {
-                advance = glyph->AdvanceX;
-                //            char nextCharacter = string[i + 1];
-                //            geometry.getAdvance(advance, character, nextCharacter);
+                set_arranged_rect(*child, {});
+                continue;
             }
 
-            float kerningOffset = 0.0f;
-            x += float(advance) + kerningOffset;
+            const auto firstColumn = std::min<std::size_t>(cell.Column, m_columns.Tracks.size() - 1);
+            const auto lastColumn = std::min<std::size_t>(cell.Column + cell.ColumnSpan, m_columns.Tracks.size()) - 1;
+            const auto firstRow = std::min<std::size_t>(cell.Row, m_rows.Tracks.size() - 1);
+            const auto lastRow = std::min<std::size_t>(cell.Row + cell.RowSpan, m_rows.Tracks.size()) - 1;
+
+            // Offsets[i + 1] includes the gap after track i (except for the last track), so take it back off.
+            const Vec2 cellTL = { m_columns.Offsets[firstColumn], m_rows.Offsets[firstRow] };
+            const Vec2 cellBR = {
+                m_columns.Offsets[lastColumn + 1] - (lastColumn + 1 < m_columns.Tracks.size() ? m_gap.x : 0.0f),
+                m_rows.Offsets[lastRow + 1] - (lastRow + 1 < m_rows.Tracks.size() ? m_gap.y : 0.0f),
+            };
+            set_arranged_rect(*child, { cellTL, cellBR });
         }
     }
 
-    void Label::set_font(Font* font)
+    void Grid::on_child_measure_invalidated(const Element& child)
     {
-        m_font = font;
-        set_dirty();
+        mark_tracks_dirty(get_cell(child));
+        invalidate_arrange();
+        invalidate_measure();
     }
 
-    void Label::set_text(const std::string& text)
+    void Grid::on_child_removed(const Element& child)
     {
-        m_text = text;
-        set_dirty();
+        // Its tracks were already marked dirty by on_child_measure_invalidated().
+        m_cells.erase(&child);
+    }
+
+    auto Grid::get_cell(const Element& element) const -> GridCell
+    {
+        const auto it = m_cells.find(&element);
+        return it != m_cells.end() ? it->second : GridCell{};
+    }
+
+    void Grid::mark_tracks_dirty(const GridCell& cell)
+    {
+        // Only single-span children size auto tracks.
+        if (cell.ColumnSpan == 1 && cell.Column < m_columns.Tracks.size() && m_columns.Tracks[cell.Column].Type == GridTrackType::Auto)
+        {
+            m_columns.ContentDirty[cell.Column] = true;
+            m_columns.ResolvedForSize = -1.0f;
+            m_contentDirty = true;
+        }
+        if (cell.RowSpan == 1 && cell.Row < m_rows.Tracks.size() && m_rows.Tracks[cell.Row].Type == GridTrackType::Auto)
+        {
+            m_rows.ContentDirty[cell.Row] = true;
+            m_rows.ResolvedForSize = -1.0f;
+            m_contentDirty = true;
+        }
+    }
+
+    void Grid::update_content_sizes() const
+    {
+        if (!m_contentDirty)
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < m_columns.Tracks.size(); ++i)
+        {
+            if (m_columns.ContentDirty[i])
+            {
+                m_columns.ContentSizes[i] = 0.0f;
+            }
+        }
+        for (std::size_t i = 0; i < m_rows.Tracks.size(); ++i)
+        {
+            if (m_rows.ContentDirty[i])
+            {
+                m_rows.ContentSizes[i] = 0.0f;
+            }
+        }
+
+        // Children in clean tracks are skipped, so only the affected tracks are remeasured.
+        for (auto child = get_first_child(); child != nullptr; child = child->get_next_sibling())
+        {
+            const auto cell = get_cell(*child);
+            const bool sizesColumn = cell.ColumnSpan == 1 && cell.Column < m_columns.Tracks.size() && m_columns.ContentDirty[cell.Column];
+            const bool sizesRow = cell.RowSpan == 1 && cell.Row < m_rows.Tracks.size() && m_rows.ContentDirty[cell.Row];
+            if (!sizesColumn && !sizesRow)
+            {
+                continue;
+            }
+
+            const auto childSize = child->get_measured_size();
+            if (sizesColumn)
+            {
+                m_columns.ContentSizes[cell.Column] = std::max(m_columns.ContentSizes[cell.Column], childSize.x);
+            }
+            if (sizesRow)
+            {
+                m_rows.ContentSizes[cell.Row] = std::max(m_rows.ContentSizes[cell.Row], childSize.y);
+            }
+        }
+
+        std::fill(m_columns.ContentDirty.begin(), m_columns.ContentDirty.end(), false);
+        std::fill(m_rows.ContentDirty.begin(), m_rows.ContentDirty.end(), false);
+        m_contentDirty = false;
+    }
+
+    void Grid::resolve_tracks(const TrackList& trackList, float size, float gap) const
+    {
+        if (trackList.ResolvedForSize == size)
+        {
+            return;
+        }
+
+        const auto trackCount = trackList.Tracks.size();
+        float usedSize = trackCount > 1 ? gap * float(trackCount - 1) : 0.0f;
+        float totalFraction = 0.0f;
+        for (std::size_t i = 0; i < trackCount; ++i)
+        {
+            const auto& track = trackList.Tracks[i];
+            switch (track.Type)
+            {
+                case GridTrackType::Fixed: usedSize += track.Value; break;
+                case GridTrackType::Fraction: totalFraction += track.Value; break;
+                case GridTrackType::Auto: usedSize += trackList.ContentSizes[i]; break;
+            }
+        }
+
+        const float freeSize = std::max(size - usedSize, 0.0f);
+        trackList.Offsets.resize(trackCount + 1);
+        float offset = 0.0f;
+        for (std::size_t i = 0; i < trackCount; ++i)
+        {
+            trackList.Offsets[i] = offset;
+
+            const auto& track = trackList.Tracks[i];
+            switch (track.Type)
+            {
+                case GridTrackType::Fixed: offset += track.Value; break;
+                case GridTrackType::Fraction: offset += totalFraction > 0.0f ? freeSize * track.Value / totalFraction : 0.0f; break;
+                case GridTrackType::Auto: offset += trackList.ContentSizes[i]; break;
+            }
+            offset += gap;
+        }
+        trackList.Offsets[trackCount] = trackCount > 0 ? offset - gap : 0.0f;
+        trackList.ResolvedForSize = size;
+    }
+
+    Stack::Stack(bool horizontal) : m_horizontal(horizontal) {}
+
+    void Stack::set_gap(float gap)
+    {
+        m_gap = gap;
+        invalidate_measure();
+        invalidate_arrange();
+    }
+
+    void Stack::set_align(StackAlign align)
+    {
+        m_align = align;
+        invalidate_arrange();
+    }
+
+    void Stack::set_justify(StackAlign justify)
+    {
+        m_justify = justify;
+        invalidate_arrange();
+    }
+
+    auto Stack::measure() const -> Vec2
+    {
+        float main = 0.0f;
+        float cross = 0.0f;
+        U32 childCount = 0;
+        for (auto child = get_first_child(); child != nullptr; child = child->get_next_sibling())
+        {
+            const auto childSize = child->get_measured_size();
+            main += m_horizontal ? childSize.x : childSize.y;
+            cross = std::max(cross, m_horizontal ? childSize.y : childSize.x);
+            ++childCount;
+        }
+        main += childCount > 1 ? m_gap * float(childCount - 1) : 0.0f;
+
+        return m_horizontal ? Vec2{ main, cross } : Vec2{ cross, main };
+    }
+
+    void Stack::arrange(const Vec2& size) const
+    {
+        const float mainSize = m_horizontal ? size.x : size.y;
+        const float crossSize = m_horizontal ? size.y : size.x;
+
+        float contentMain = 0.0f;
+        float totalGrow = 0.0f;
+        float totalShrink = 0.0f;
+        U32 childCount = 0;
+        for (auto child = get_first_child(); child != nullptr; child = child->get_next_sibling())
+        {
+            const auto childSize = child->get_measured_size();
+            const float childMain = m_horizontal ? childSize.x : childSize.y;
+            contentMain += childMain;
+            totalGrow += child->get_flex_grow();
+            totalShrink += child->get_flex_shrink() * childMain;  // Big children give up more, as in CSS flexbox
+            ++childCount;
+        }
+        contentMain += childCount > 1 ? m_gap * float(childCount - 1) : 0.0f;
+
+        const float freeSpace = mainSize - contentMain;
+        float main = 0.0f;
+        if (freeSpace > 0.0f && totalGrow <= 0.0f)
+        {
+            main = m_justify == StackAlign::Center ? freeSpace * 0.5f : m_justify == StackAlign::End ? freeSpace : 0.0f;
+        }
+
+        for (auto child = get_first_child(); child != nullptr; child = child->get_next_sibling())
+        {
+            const auto childSize = child->get_measured_size();
+            float childMain = m_horizontal ? childSize.x : childSize.y;
+            float childCross = m_horizontal ? childSize.y : childSize.x;
+
+            if (freeSpace > 0.0f && totalGrow > 0.0f)
+            {
+                childMain += freeSpace * child->get_flex_grow() / totalGrow;
+            }
+            else if (freeSpace < 0.0f && totalShrink > 0.0f)
+            {
+                childMain = std::max(childMain + freeSpace * child->get_flex_shrink() * childMain / totalShrink, 0.0f);
+            }
+
+            float cross = 0.0f;
+            switch (m_align)
+            {
+                case StackAlign::Start: break;
+                case StackAlign::Center: cross = (crossSize - childCross) * 0.5f; break;
+                case StackAlign::End: cross = crossSize - childCross; break;
+                case StackAlign::Stretch: childCross = crossSize; break;
+            }
+
+            const Rect rect = m_horizontal ? Rect{ { main, cross }, { main + childMain, cross + childCross } }
+                                           : Rect{ { cross, main }, { cross + childCross, main + childMain } };
+            set_arranged_rect(*child, rect);
+            main += childMain + m_gap;
+        }
+    }
+
+    Button::Button()
+    {
+        set_enabled_states(RETGUI_ELEMENT_STATE_HOVERED | RETGUI_ELEMENT_STATE_ACTIVE);
+    }
+
+    void Button::set_on_clicked(std::function<void()>&& callback)
+    {
+        m_onClicked = callback;
+    }
+
+    void Button::on_mouse_button_up(int button)
+    {
+        m_onClicked();
+    }
+
+    Label::Label() = default;
+
+    void Label::render(DrawData& drawData) const
+    {
+        auto& io = get_current_context()->io;
+        drawData.add_draw_cmd(io.Fonts.get_tex_id());
+
+        const auto screenPos = get_screen_position();
+        const auto color = get_render_color().Int32();
+
+        ensure_shaped();
+        const Vec2 origin = { std::roundf(screenPos.x), std::roundf(screenPos.y) };
+
+        // Text in fonts below the threshold is drawn as bars, so only the glyphs of readable fonts are left to draw.
+        const auto* context = get_current_context();
+        const auto greekingThreshold = context->greekingThreshold;
+        bool hasGreekedText = m_font->FontSize < greekingThreshold;
+        for (const auto& span : m_spans)
+        {
+            hasGreekedText |= span.FontOverride != nullptr && span.FontOverride->FontSize < greekingThreshold;
+        }
+        if (hasGreekedText)
+        {
+            render_greeked(drawData, origin, color, greekingThreshold, context->greekingMode);
+        }
+
+        // Consecutive glyphs on the same page (whatever their font or color) share a draw command.
+        U32 currentPage = 0;
+        for (const auto& glyph : m_shapedGlyphs)
+        {
+            if (glyph.FontSize < greekingThreshold)
+            {
+                continue;
+            }
+            if (glyph.Page != currentPage)
+            {
+                drawData.add_draw_cmd(io.Fonts.get_tex_id(glyph.Page));
+                currentPage = glyph.Page;
+            }
+            drawData.add_textured_rect(origin + glyph.Min, origin + glyph.Max, glyph.Color != 0 ? glyph.Color : color, glyph.UvMin, glyph.UvMax);
+        }
+    }
+
+    void Label::on_atlas_rebuilt()
+    {
+        // The advances may have changed too (eg. an async font replacing its placeholder), so the measured size is stale.
+        m_shapeDirty = true;
+        invalidate_measure();
+    }
+
+    void Label::render_greeked(DrawData& drawData, const Vec2& origin, U32 color, float greekingThreshold, TextGreeking greekingMode) const
+    {
+        // Follows the shaped pen positions, but runs of characters in a font below the threshold become a single bar covering
+        // the x-height. A bar ends where the font or color changes.
+        const ShapedLine* barLine = nullptr;
+        const Font* barFont = nullptr;
+        U32 barColor = 0;
+        float barStart = 0.0f;
+        float barEnd = 0.0f;
+
+        const auto flushBar = [&]() {
+            if (barFont != nullptr && barEnd > barStart)
+            {
+                const float baseline = origin.y + barLine->Baseline;
+                Vec2 barTL = { origin.x + barStart, std::roundf(baseline - barFont->Ascender * 0.5f) };
+                Vec2 barBR = { origin.x + barEnd, baseline };
+                drawData.add_rect(barTL, { barBR.x, std::max(barBR.y, barTL.y + 1.0f) }, barColor);
+            }
+            barFont = nullptr;
+        };
+
+        std::size_t spanIdx = 0;
+        for (const auto& line : m_shapedLines)
+        {
+            for (std::size_t i = 0; i + 1 < line.CaretOffsets.size(); ++i)
+            {
+                const auto offset = line.Begin + line.CaretOffsets[i];
+                while (spanIdx < m_spans.size() && m_spans[spanIdx].End <= offset)
+                {
+                    ++spanIdx;
+                }
+                const auto* span = spanIdx < m_spans.size() && m_spans[spanIdx].Begin <= offset ? &m_spans[spanIdx] : nullptr;
+                const auto* font = span != nullptr && span->FontOverride != nullptr ? span->FontOverride : m_font;
+                const auto charColor = span != nullptr && span->ColorOverride != 0 ? span->ColorOverride : color;
+
+                // Spaces & tabs are single bytes, so the first byte tells them apart.
+                const bool isSpace = m_text[offset] == ' ' || m_text[offset] == '\t';
+                if (font->FontSize >= greekingThreshold || (isSpace && greekingMode == TextGreeking::Word))
+                {
+                    flushBar();
+                    continue;
+                }
+                if (barFont != nullptr && (font != barFont || charColor != barColor))
+                {
+                    flushBar();
+                }
+                if (barFont == nullptr)
+                {
+                    if (isSpace)
+                    {
+                        continue;  // Bars don't start with a space
+                    }
+                    barLine = &line;
+                    barFont = font;
+                    barColor = charColor;
+                    barStart = line.CaretX[i];
+                }
+                barEnd = line.CaretX[i + 1];
+            }
+            flushBar();
+        }
+    }
+
+    void Label::set_font(Font* font)
+    {
+        m_font = font;
+        m_shapeDirty = true;
+        invalidate_measure();
+        set_dirty();
+    }
+
+    void Label::set_text(const std::string& text)
+    {
+        auto* charsetRecorder = get_current_context()->charsetRecorder;
+        if (charsetRecorder != nullptr)
+        {
+            charsetRecorder->add_text(text);
+        }
+
+        m_text = text;
+        m_spans.clear();
+        m_shapeDirty = true;
+        invalidate_measure();
+        set_dirty();
+    }
+
+    void Label::set_spans(const std::vector<TextSpan>& spans)
+    {
+        m_spans = spans;
+        std::sort(m_spans.begin(), m_spans.end(), [](const TextSpan& a, const TextSpan& b) { return a.Begin < b.Begin; });
+        m_shapeDirty = true;
+        invalidate_measure();
+        set_dirty();
+    }
+
+    void Label::add_text(const std::string& text, Font* font, U32 color)
+    {
+        auto* charsetRecorder = get_current_context()->charsetRecorder;
+        if (charsetRecorder != nullptr)
+        {
+            charsetRecorder->add_text(text);
+        }
+
+        m_spans.push_back({ m_text.size(), m_text.size() + text.size(), font, color });
+        m_text += text;
+        m_shapeDirty = true;
+        invalidate_measure();
+        set_dirty();
+    }
+
+    auto Label::get_char_at(const Vec2& screenPos) const -> std::size_t
+    {
+        if (m_font == nullptr)
+        {
+            return std::string::npos;
+        }
+        ensure_shaped();
+
+        const auto screenPosition = get_screen_position() + get_layer_offset();
+        const Vec2 localPos = { screenPos.x - std::roundf(screenPosition.x), screenPos.y - std::roundf(screenPosition.y) };
+        const auto& line = m_shapedLines[get_line_at(localPos.y)];
+        if (localPos.y < line.Top || localPos.y >= line.Top + line.Height || localPos.x < 0.0f || localPos.x >= line.CaretX.back())
+        {
+            return std::string::npos;
+        }
+
+        const auto it = std::upper_bound(line.CaretX.begin(), line.CaretX.end(), localPos.x);
+        return line.Begin + line.CaretOffsets[std::size_t(it - line.CaretX.begin()) - 1];
+    }
+
+    auto Label::get_caret_offset_at(const Vec2& screenPos) const -> std::size_t
+    {
+        if (m_font == nullptr)
+        {
+            return 0;
+        }
+        ensure_shaped();
+
+        const auto screenPosition = get_screen_position() + get_layer_offset();
+        const Vec2 localPos = { screenPos.x - std::roundf(screenPosition.x), screenPos.y - std::roundf(screenPosition.y) };
+        const auto& line = m_shapedLines[get_line_at(localPos.y)];
+
+        auto stop = std::size_t(std::lower_bound(line.CaretX.begin(), line.CaretX.end(), localPos.x) - line.CaretX.begin());
+        if (stop == line.CaretX.size())
+        {
+            stop = line.CaretX.size() - 1;
+        }
+        else if (stop > 0 && localPos.x - line.CaretX[stop - 1] < line.CaretX[stop] - localPos.x)
+        {
+            --stop;  // Closer to the previous boundary
+        }
+        return line.Begin + line.CaretOffsets[stop];
+    }
+
+    auto Label::get_char_bounds(std::size_t offset) const -> Rect
+    {
+        if (m_font == nullptr)
+        {
+            return {};
+        }
+        ensure_shaped();
+
+        const auto& line = m_shapedLines[get_line_of_offset(offset)];
+        const auto it = std::lower_bound(line.CaretOffsets.begin(), line.CaretOffsets.end(), U32(offset - line.Begin));
+        const auto stop = std::min(std::size_t(it - line.CaretOffsets.begin()), line.CaretOffsets.size() - 1);
+        const auto nextStop = std::min(stop + 1, line.CaretX.size() - 1);
+
+        const auto screenPosition = get_screen_position() + get_layer_offset();
+        const Vec2 origin = { std::roundf(screenPosition.x), std::roundf(screenPosition.y) };
+        return {
+            { origin.x + line.CaretX[stop], origin.y + line.Top },
+            { origin.x + line.CaretX[nextStop], origin.y + line.Top + line.Height },
+        };
+    }
+
+    auto Label::measure() const -> Vec2
+    {
+        if (m_font == nullptr)
+        {
+            return Element::measure();
+        }
+        ensure_shaped();
+
+        float width = 0.0f;
+        for (const auto& line : m_shapedLines)
+        {
+            width = std::max(width, line.CaretX.back());
+        }
+        return { width, m_shapedLines.back().Top + m_shapedLines.back().Height };
+    }
+
+    void Label::ensure_shaped() const
+    {
+        const auto atlasGeneration = get_current_context()->io.Fonts.get_atlas_generation();
+        if (m_shapeDirty || m_shapedAtlasGeneration != atlasGeneration)
+        {
+            shape();
+            m_shapeDirty = false;
+            m_shapedAtlasGeneration = atlasGeneration;
+        }
+    }
+
+    auto Label::get_line_at(float y) const -> std::size_t
+    {
+        const auto it = std::upper_bound(
+            m_shapedLines.begin(), m_shapedLines.end(), y, [](float value, const ShapedLine& line) { return value < line.Top; });
+        return it == m_shapedLines.begin() ? 0 : std::size_t(it - m_shapedLines.begin()) - 1;
+    }
+
+    auto Label::get_line_of_offset(std::size_t offset) const -> std::size_t
+    {
+        const auto it = std::upper_bound(m_shapedLines.begin(),
+                                         m_shapedLines.end(),
+                                         offset,
+                                         [](std::size_t value, const ShapedLine& line) { return value < line.Begin; });
+        return std::size_t(it - m_shapedLines.begin()) - 1;
+    }
+
+    void Label::shape() const
+    {
+        m_shapedGlyphs.clear();
+        m_shapedLines.assign(1, ShapedLine{});
+        m_shapedLines.back().CaretX.push_back(0.0f);
+        m_shapedLines.back().CaretOffsets.push_back(0);
+
+        const auto& whitePixelCoords = get_current_context()->io.Fonts.get_white_pixel_coords();
+        const char* textBegin = m_text.data();
+        const char* textEnd = m_text.data() + m_text.size();
+
+        float x = 0.0f;
+        float lineTop = 0.0f;
+        float lineAscender = m_font->Ascender;
+        float lineSpacing = m_font->LineSpacing;
+        std::size_t lineFirstGlyph = 0;
+        std::size_t spanIdx = 0;
+
+        // Glyphs are placed relative to the baseline, then moved down once the line's tallest font is known.
+        const auto finishLine = [&]() {
+            const float baseline = std::roundf(lineTop + lineAscender);
+            for (auto i = lineFirstGlyph; i < m_shapedGlyphs.size(); ++i)
+            {
+                m_shapedGlyphs[i].Min.y += baseline;
+                m_shapedGlyphs[i].Max.y += baseline;
+            }
+            lineFirstGlyph = m_shapedGlyphs.size();
+            m_shapedLines.back().Top = lineTop;
+            m_shapedLines.back().Height = lineSpacing;
+            m_shapedLines.back().Baseline = baseline;
+            lineTop += lineSpacing;
+            lineAscender = m_font->Ascender;
+            lineSpacing = m_font->LineSpacing;
+            x = 0.0f;
+        };
+
+        for (const char* it = textBegin; it < textEnd;)
+        {
+            const auto offset = std::size_t(it - textBegin);
+            U32 character{};
+            it += utf8_decode(it, textEnd, character);
+
+            if (character == '\n')
+            {
+                finishLine();
+                m_shapedLines.push_back({ std::size_t(it - textBegin), 0.0f, 0.0f, 0.0f, { 0.0f }, { 0 } });
+                continue;
+            }
+
+            // Record the pen position after this character, whatever it turns out to draw.
+            auto& shapedLine = m_shapedLines.back();
+            const auto recordCaret = [&]() {
+                shapedLine.CaretX.push_back(x);
+                shapedLine.CaretOffsets.push_back(U32(std::size_t(it - textBegin) - shapedLine.Begin));
+            };
+
+            while (spanIdx < m_spans.size() && m_spans[spanIdx].End <= offset)
+            {
+                ++spanIdx;
+            }
+            const auto* span = spanIdx < m_spans.size() && m_spans[spanIdx].Begin <= offset ? &m_spans[spanIdx] : nullptr;
+            const auto* font = span != nullptr && span->FontOverride != nullptr ? span->FontOverride : m_font;
+            const auto color = span != nullptr ? span->ColorOverride : 0;
+            lineAscender = std::max(lineAscender, font->Ascender);
+            lineSpacing = std::max(lineSpacing, font->LineSpacing);
+
+            auto* glyph = font->get_glyph(character);
+            if (glyph == nullptr)
+            {
+                glyph = font->get_glyph('?');
+            }
+            if (glyph == nullptr)
+            {
+                // The font has no glyphs yet (eg. it is still being built asynchronously), so draw a block per character.
+                const auto blockAdvance = std::roundf(font->FontSize * 0.5f);
+                if (character != ' ')
+                {
+                    m_shapedGlyphs.push_back({
+                        { std::roundf(x), std::roundf(-font->Ascender * 0.5f) },
+                        { std::roundf(x + blockAdvance * 0.75f), 0.0f },
+                        whitePixelCoords,
+                        whitePixelCoords,
+                        color,
+                        0,
+                        font->FontSize,
+                    });
+                }
+                x += blockAdvance;
+                recordCaret();
+                continue;
+            }
+
+            m_shapedGlyphs.push_back({
+                { std::roundf(x + glyph->x0), std::roundf(glyph->y0) },
+                { std::roundf(x + glyph->x1), std::roundf(glyph->y1) },
+                { glyph->ux0, glyph->uy0 },
+                { glyph->ux1, glyph->uy1 },
+                color,
+                glyph->Page,
+                font->FontSize,
+            });
+            x += glyph->AdvanceX;
+            recordCaret();
+        }
+        finishLine();
+    }
+
+    void TextGrid::render(DrawData& drawData) const
+    {
+        auto* context = get_current_context();
+        drawData.add_draw_cmd(context->io.Fonts.get_tex_id());
+
+        m_renderOrigin = get_screen_position();
+        m_renderGeneration = context->drawDataGeneration;
+        m_quadOffset = drawData.get_quad_count();
+
+        const auto cellCount = U32(m_cells.size());
+        drawData.reserve_quads(cellCount * 2);  // The cells' slots
+        for (U32 i = 0; i < cellCount; ++i)
+        {
+            write_cell_quads(drawData, i);
+        }
+    }
+
+    void TextGrid::set_font(Font* font)
+    {
+        m_font = font;
+        set_dirty();
+    }
+
+    void TextGrid::set_grid_size(U32 columns, U32 rows)
+    {
+        std::vector<TextCell> cells(columns * rows);
+        for (U32 row = 0; row < std::min(rows, m_rows); ++row)
+        {
+            for (U32 column = 0; column < std::min(columns, m_columns); ++column)
+            {
+                cells[column + row * columns] = m_cells[column + row * m_columns];
+            }
+        }
+
+        m_cells = std::move(cells);
+        m_columns = columns;
+        m_rows = rows;
+        set_dirty();
+    }
+
+    auto TextGrid::get_cell_size() const -> Vec2
+    {
+        if (m_font == nullptr)
+        {
+            return {};
+        }
+
+        const auto* glyph = m_font->get_glyph('M');
+        const float advance = glyph != nullptr ? glyph->AdvanceX : std::roundf(m_font->FontSize * 0.5f);
+        return { advance, m_font->LineSpacing };
+    }
+
+    auto TextGrid::get_cell(U32 column, U32 row) const -> const TextCell&
+    {
+        if (column >= m_columns || row >= m_rows)
+        {
+            static const TextCell emptyCell{};
+            return emptyCell;
+        }
+        return m_cells[column + row * m_columns];
+    }
+
+    void TextGrid::set_cell(U32 column, U32 row, const TextCell& cell)
+    {
+        if (column >= m_columns || row >= m_rows)
+        {
+            return;
+        }
+
+        const auto cellIdx = column + row * m_columns;
+        m_cells[cellIdx] = cell;
+
+        if (can_patch())
+        {
+            auto* context = get_current_context();
+            write_cell_quads(context->drawData, cellIdx);
+            context->drawDataPatched = true;
+        }
+        else
+        {
+            set_dirty();
+        }
+    }
+
+    void TextGrid::write_text(U32 column, U32 row, const std::string& text, U32 foreground, U32 background)
+    {
+        if (row >= m_rows)
+        {
+            return;
+        }
+
+        utf8_for_each(text.data(), text.data() + text.size(), [&](U32 character) {
+            if (column < m_columns)
+            {
+                set_cell(column++, row, TextCell{ character, foreground, background });
+            }
+        });
+    }
+
+    void TextGrid::clear_cells(const TextCell& cell)
+    {
+        std::fill(m_cells.begin(), m_cells.end(), cell);
+        set_dirty();
+    }
+
+    bool TextGrid::can_patch() const
+    {
+        const auto* context = get_current_context();
+        // Only while the DrawData still holds our slots from the last full render, and nothing moved us since.
+        return !context->dirty && m_renderGeneration == context->drawDataGeneration && m_renderGeneration != 0;
+    }
+
+    void TextGrid::write_cell_quads(DrawData& drawData, U32 cellIdx) const
+    {
+        const auto& cell = m_cells[cellIdx];
+        const auto cellSize = get_cell_size();
+        const Vec2 cellTL = {
+            m_renderOrigin.x + float(cellIdx % m_columns) * cellSize.x,
+            m_renderOrigin.y + float(cellIdx / m_columns) * cellSize.y,
+        };
+
+        const auto& whitePixelCoords = drawData.WhitePixelUv;
+        const auto bgQuadIdx = m_quadOffset + cellIdx;
+        drawData.write_textured_rect(bgQuadIdx, cellTL, cellTL + cellSize, cell.Background, whitePixelCoords, whitePixelCoords);
+
+        const auto glyphQuadIdx = m_quadOffset + U32(m_cells.size()) + cellIdx;
+        const auto* glyph = m_font != nullptr ? m_font->get_glyph(cell.CodePoint) : nullptr;
+        if (glyph == nullptr || glyph->Page != 0 || cell.CodePoint == ' ')
+        {
+            drawData.write_textured_rect(glyphQuadIdx, cellTL, cellTL, 0, whitePixelCoords, whitePixelCoords);  // Empty
+            return;
+        }
+
+        const float baseline = cellTL.y + m_font->Ascender;
+        Vec2 quadTL = { std::roundf(cellTL.x + glyph->x0), std::roundf(baseline + glyph->y0) };
+        Vec2 quadBR = { std::roundf(cellTL.x + glyph->x1), std::roundf(baseline + glyph->y1) };
+        drawData.write_textured_rect(glyphQuadIdx, quadTL, quadBR, cell.Foreground, { glyph->ux0, glyph->uy0 }, { glyph->ux1, glyph->uy1 });
+    }
+
+    void LogView::render(DrawData& drawData) const
+    {
+        if (m_font == nullptr)
+        {
+            return;
+        }
+
+        const auto screenPos = get_screen_position();
+        const auto color = get_render_color().Int32();
+
+        const auto lastLine = std::min(get_line_count(), m_scrollLine + get_visible_line_count());
+        for (auto line = m_scrollLine; line < lastLine; ++line)
+        {
+            std::uint64_t begin{};
+            std::uint64_t end{};
+            get_line_range(line, begin, end);
+
+            const auto* text = get_bytes(begin, end - begin, m_scratch);
+            auto length = std::size_t(end - begin);
+            if (length > 0 && text[length - 1] == '\r')
+            {
+                --length;
+            }
+
+            const Vec2 linePos = { screenPos.x, screenPos.y + float(line - m_scrollLine) * m_font->LineSpacing };
+            drawData.add_text(*m_font, linePos, color, text, text + length);
+        }
+    }
+
+    void LogView::set_font(Font* font)
+    {
+        m_font = font;
+        set_dirty();
+    }
+
+    void LogView::append(const char* text, std::size_t length)
+    {
+        if (m_externalText != nullptr)
+        {
+            throw std::runtime_error("Cannot append to a LogView viewing external text!");
+        }
+
+        const auto firstChangedLine = get_line_count() - 1;
+
+        // Scan for line starts before copying, while the bytes are contiguous.
+        const char* scan = text;
+        const char* textEnd = text + length;
+        while (scan < textEnd)
+        {
+            const auto* newline = static_cast<const char*>(std::memchr(scan, '\n', std::size_t(textEnd - scan)));
+            if (newline == nullptr)
+            {
+                break;
+            }
+            m_lineOffsets.push_back(m_size + std::uint64_t(newline - text) + 1);
+            scan = newline + 1;
+        }
+
+        while (length > 0)
+        {
+            const auto chunkOffset = std::size_t(m_size % ChunkSize);
+            if (chunkOffset == 0)
+            {
+                m_chunks.push_back(std::make_unique<char[]>(ChunkSize));
+            }
+
+            const auto copyLength = std::min(length, ChunkSize - chunkOffset);
+            std::memcpy(m_chunks.back().get() + chunkOffset, text, copyLength);
+            text += copyLength;
+            length -= copyLength;
+            m_size += copyLength;
+        }
+
+        if (m_followTail)
+        {
+            set_scroll_line(get_max_scroll_line());
+        }
+        if (is_line_visible(firstChangedLine) || is_line_visible(get_line_count() - 1))
+        {
+            set_dirty();
+        }
+    }
+
+    void LogView::append(const std::string& text)
+    {
+        append(text.data(), text.size());
+    }
+
+    void LogView::set_external_text(const char* text, std::size_t length)
+    {
+        m_chunks.clear();
+        m_externalText = text;
+        m_size = length;
+
+        m_lineOffsets.assign(1, 0);
+        const char* scan = text;
+        const char* textEnd = text + length;
+        while (scan < textEnd)  // Also keeps set_external_text(nullptr, 0) away from memchr
+        {
+            const auto* newline = static_cast<const char*>(std::memchr(scan, '\n', std::size_t(textEnd - scan)));
+            if (newline == nullptr)
+            {
+                break;
+            }
+            m_lineOffsets.push_back(std::uint64_t(newline - text) + 1);
+            scan = newline + 1;
+        }
+
+        m_scrollLine = m_followTail ? get_max_scroll_line() : 0;
+        set_dirty();
+    }
+
+    void LogView::clear()
+    {
+        m_chunks.clear();
+        m_externalText = nullptr;
+        m_size = 0;
+        m_lineOffsets.assign(1, 0);
+        m_scrollLine = 0;
+        set_dirty();
+    }
+
+    auto LogView::get_line(std::size_t line) const -> std::string
+    {
+        std::uint64_t begin{};
+        std::uint64_t end{};
+        get_line_range(line, begin, end);
+
+        std::string scratch{};
+        const auto* text = get_bytes(begin, end - begin, scratch);
+        auto length = std::size_t(end - begin);
+        if (length > 0 && text[length - 1] == '\r')
+        {
+            --length;
+        }
+        return std::string(text, length);
+    }
+
+    auto LogView::get_line_at_offset(std::uint64_t offset) const -> std::size_t
+    {
+        const auto it = std::upper_bound(m_lineOffsets.begin(), m_lineOffsets.end(), offset);
+        return std::size_t(it - m_lineOffsets.begin()) - 1;
+    }
+
+    auto LogView::get_visible_line_count() const -> std::size_t
+    {
+        if (m_font == nullptr || m_font->LineSpacing <= 0.0f)
+        {
+            return 0;
+        }
+        // Only whole lines, nothing is clipped.
+        return std::size_t(std::max(get_screen_size().y, 0.0f) / m_font->LineSpacing);
+    }
+
+    void LogView::set_scroll_line(std::size_t line)
+    {
+        line = std::min(line, get_max_scroll_line());
+        if (line == m_scrollLine)
+        {
+            return;
+        }
+
+        m_scrollLine = line;
+        set_dirty();
+    }
+
+    void LogView::scroll_to_offset(std::uint64_t offset)
+    {
+        set_scroll_line(get_line_at_offset(offset));
+    }
+
+    void LogView::set_follow_tail(bool followTail)
+    {
+        m_followTail = followTail;
+        if (m_followTail)
+        {
+            set_scroll_line(get_max_scroll_line());
+        }
+    }
+
+    void LogView::get_line_range(std::size_t line, std::uint64_t& outBegin, std::uint64_t& outEnd) const
+    {
+        if (line >= m_lineOffsets.size())
+        {
+            // Lines past the end are empty.
+            outBegin = m_size;
+            outEnd = m_size;
+            return;
+        }
+
+        outBegin = m_lineOffsets[line];
+        outEnd = line + 1 < m_lineOffsets.size() ? m_lineOffsets[line + 1] - 1 : m_size;  // Excludes the '\n'
+    }
+
+    auto LogView::get_bytes(std::uint64_t offset, std::uint64_t length, std::string& scratch) const -> const char*
+    {
+        if (m_externalText != nullptr)
+        {
+            return m_externalText + offset;
+        }
+
+        auto chunkIdx = std::size_t(offset / ChunkSize);
+        auto chunkOffset = std::size_t(offset % ChunkSize);
+        if (chunkOffset + length <= ChunkSize)
+        {
+            return chunkIdx < m_chunks.size() ? m_chunks[chunkIdx].get() + chunkOffset : "";
+        }
+
+        scratch.resize(std::size_t(length));
+        std::size_t copied = 0;
+        while (copied < length)
+        {
+            const auto copyLength = std::min(std::size_t(length) - copied, ChunkSize - chunkOffset);
+            std::memcpy(scratch.data() + copied, m_chunks[chunkIdx].get() + chunkOffset, copyLength);
+            copied += copyLength;
+            ++chunkIdx;
+            chunkOffset = 0;
+        }
+        return scratch.data();
+    }
+
+    auto LogView::get_max_scroll_line() const -> std::size_t
+    {
+        const auto visibleLines = std::max<std::size_t>(get_visible_line_count(), 1);
+        return get_line_count() > visibleLines ? get_line_count() - visibleLines : 0;
+    }
+
+    bool LogView::is_line_visible(std::size_t line) const
+    {
+        return line >= m_scrollLine && line < m_scrollLine + get_visible_line_count();
+    }
+
+    TextBox::TextBox()
+    {
+        set_enabled_states(RETGUI_ELEMENT_STATE_HOVERED | RETGUI_ELEMENT_STATE_ACTIVE | RETGUI_ELEMENT_STATE_FOCUSED);
+    }
+
+    void TextBox::render(DrawData& drawData) const
+    {
+        ensure_shaped();
+
+        auto* context = get_current_context();
+        drawData.add_draw_cmd(context->io.Fonts.get_tex_id());
+
+        m_renderOrigin = get_screen_position();
+        m_renderGeneration = context->drawDataGeneration;
+
+        for (std::size_t i = 0; i < m_lines.size(); ++i)
+        {
+            // Leave room for the line to grow, so typing can be patched in place.
+            const auto& line = m_lines[i];
+            line.QuadOffset = drawData.get_quad_count();
+            line.GlyphCapacity = (U32(line.Glyphs.size()) + 16u) & ~15u;
+            drawData.reserve_quads(1 + line.GlyphCapacity);  // The selection & glyph slots
+
+            write_selection_quad(drawData, i);
+            write_line_quads(drawData, i);
+        }
+
+        m_caretQuadIdx = drawData.reserve_quads(1).FirstQuad;
+        write_caret_quad(drawData);
+    }
+
+    void TextBox::set_font(Font* font)
+    {
+        m_font = font;
+        shape_all_lines();
+        set_dirty();
+    }
+
+    void TextBox::set_text(const std::string& text)
+    {
+        m_buffer.assign(text);
+        m_caret = m_selectionAnchor = 0;
+        shape_all_lines();
+        set_dirty();
+    }
+
+    void TextBox::set_caret(std::size_t offset, bool extendSelection)
+    {
+        set_selection(extendSelection ? m_selectionAnchor : offset, offset);
+    }
+
+    void TextBox::set_selection(std::size_t anchor, std::size_t caret)
+    {
+        ensure_shaped();
+        const auto oldFirstLine = get_line_index(get_selection_begin());
+        const auto oldLastLine = get_line_index(get_selection_end());
+
+        m_selectionAnchor = std::min(anchor, m_buffer.size());
+        m_caret = std::min(caret, m_buffer.size());
+        patch_caret_and_selection(oldFirstLine, oldLastLine);
+    }
+
+    void TextBox::insert_text(const std::string& text)
+    {
+        replace(get_selection_begin(), get_selection_end(), text);
+    }
+
+    void TextBox::erase_selection()
+    {
+        replace(get_selection_begin(), get_selection_end(), {});
+    }
+
+    auto TextBox::get_offset_at(const Vec2& screenPos) const -> std::size_t
+    {
+        ensure_shaped();
+        const auto origin = get_screen_position() + get_layer_offset();
+        const float lineSpacing = m_font != nullptr ? m_font->LineSpacing : 0.0f;
+
+        std::size_t lineIdx = 0;
+        if (lineSpacing > 0.0f && screenPos.y > origin.y)
+        {
+            lineIdx = std::min(std::size_t((screenPos.y - origin.y) / lineSpacing), m_lines.size() - 1);
+        }
+        return get_offset_in_line(m_lines[lineIdx], screenPos.x - origin.x);
+    }
+
+    void TextBox::set_caret_color(U32 color)
+    {
+        m_caretColor = color;
+        set_dirty();
+    }
+
+    void TextBox::set_selection_color(U32 color)
+    {
+        m_selectionColor = color;
+        set_dirty();
+    }
+
+    void TextBox::on_mouse_button_down(int)
+    {
+        const auto& io = get_current_context()->io;
+        set_caret(get_offset_at(io.cursorPos), io.keyShift);
+    }
+
+    void TextBox::on_key_pressed(Key key)
+    {
+        ensure_shaped();
+        const bool shift = get_current_context()->io.keyShift;
+        const auto& line = m_lines[get_line_index(m_caret)];
+        switch (key)
+        {
+            case Key::Left:
+                set_caret(has_selection() && !shift ? get_selection_begin() : get_prev_offset(m_caret), shift);
+                break;
+            case Key::Right:
+                set_caret(has_selection() && !shift ? get_selection_end() : get_next_offset(m_caret), shift);
+                break;
+            case Key::Up:
+                move_caret_line(-1, shift);
+                break;
+            case Key::Down:
+                move_caret_line(1, shift);
+                break;
+            case Key::Home:
+                set_caret(line.Begin, shift);
+                break;
+            case Key::End:
+                set_caret(line.Begin + line.Length, shift);
+                break;
+            case Key::Backspace:
+                if (has_selection())
+                {
+                    erase_selection();
+                }
+                else
+                {
+                    replace(get_prev_offset(m_caret), m_caret, {});
+                }
+                break;
+            case Key::Delete:
+                if (has_selection())
+                {
+                    erase_selection();
+                }
+                else
+                {
+                    replace(m_caret, get_next_offset(m_caret), {});
+                }
+                break;
+            case Key::Enter:
+                insert_text("\n");
+                break;
+            default:
+                break;
+        }
+    }
+
+    void TextBox::on_text_input(U32 character)
+    {
+        if (character < 0x20 || character == 0x7F)
+        {
+            return;  // Control characters come through on_key_pressed()
+        }
+
+        char encoded[4];
+        const auto length = utf8_encode(character, encoded);
+        insert_text(std::string(encoded, std::size_t(length)));
+    }
+
+    void TextBox::replace(std::size_t begin, std::size_t end, const std::string& text)
+    {
+        ensure_shaped();
+        const auto firstLine = get_line_index(begin);
+        const auto lastLine = get_line_index(end);
+        const auto oldSelectionFirstLine = get_line_index(get_selection_begin());
+        const auto oldSelectionLastLine = get_line_index(get_selection_end());
+        const auto regionBegin = m_lines[firstLine].Begin;
+        const auto oldRegionEnd = m_lines[lastLine].Begin + m_lines[lastLine].Length;
+
+        m_buffer.erase(begin, end - begin);
+        m_buffer.insert(begin, text.data(), text.size());
+        const auto newRegionEnd = oldRegionEnd - (end - begin) + text.size();
+
+        // Only the lines the edit touched are split & reshaped.
+        std::vector<TextLine> newLines{};
+        auto lineBegin = regionBegin;
+        for (auto pos = regionBegin; pos < newRegionEnd; ++pos)
+        {
+            if (m_buffer[pos] == '\n')
+            {
+                newLines.push_back({ lineBegin, pos - lineBegin });
+                lineBegin = pos + 1;
+            }
+        }
+        newLines.push_back({ lineBegin, newRegionEnd - lineBegin });
+
+        const auto oldLineCount = lastLine - firstLine + 1;
+        bool fitsSlots = newLines.size() == oldLineCount;
+        for (std::size_t i = 0; i < newLines.size(); ++i)
+        {
+            shape_line(newLines[i]);
+            if (fitsSlots)
+            {
+                newLines[i].QuadOffset = m_lines[firstLine + i].QuadOffset;
+                newLines[i].GlyphCapacity = m_lines[firstLine + i].GlyphCapacity;
+                fitsSlots = newLines[i].Glyphs.size() <= newLines[i].GlyphCapacity;
+            }
+        }
+
+        for (auto i = lastLine + 1; i < m_lines.size(); ++i)
+        {
+            m_lines[i].Begin = m_lines[i].Begin + text.size() - (end - begin);
+        }
+        m_lines.erase(m_lines.begin() + std::ptrdiff_t(firstLine), m_lines.begin() + std::ptrdiff_t(lastLine + 1));
+        m_lines.insert(m_lines.begin() + std::ptrdiff_t(firstLine), newLines.begin(), newLines.end());
+
+        m_caret = m_selectionAnchor = begin + text.size();
+
+        if (fitsSlots && can_patch())
+        {
+            auto& drawData = get_current_context()->drawData;
+            for (auto i = firstLine; i <= lastLine; ++i)
+            {
+                write_line_quads(drawData, i);
+            }
+            patch_caret_and_selection(oldSelectionFirstLine, oldSelectionLastLine);
+        }
+        else
+        {
+            set_dirty();
+        }
+    }
+
+    void TextBox::ensure_shaped() const
+    {
+        const auto atlasGeneration = get_current_context()->io.Fonts.get_atlas_generation();
+        if (m_shapedAtlasGeneration != atlasGeneration)
+        {
+            for (auto& line : m_lines)
+            {
+                shape_line(line);
+            }
+            m_shapedAtlasGeneration = atlasGeneration;
+            set_dirty();  // The quads of the last render() still use the old UVs
+        }
+    }
+
+    void TextBox::shape_line(TextLine& line) const
+    {
+        line.Glyphs.clear();
+        line.CaretX.assign(1, 0.0f);
+        line.CaretOffsets.assign(1, 0);
+        if (m_font == nullptr)
+        {
+            return;
+        }
+
+        const auto text = m_buffer.substr(line.Begin, line.Length);
+        const char* textBegin = text.data();
+        const char* textEnd = text.data() + text.size();
+        const float baseline = m_font->Ascender;
+
+        float x = 0.0f;
+        for (const char* it = textBegin; it < textEnd;)
+        {
+            U32 character{};
+            it += utf8_decode(it, textEnd, character);
+
+            auto* glyph = m_font->get_glyph(character);
+            if (glyph == nullptr)
+            {
+                glyph = m_font->get_glyph('?');
+            }
+
+            if (glyph != nullptr && glyph->Page == 0 && character != ' ')
+            {
+                line.Glyphs.push_back({
+                    { std::roundf(x + glyph->x0), std::roundf(baseline + glyph->y0) },
+                    { std::roundf(x + glyph->x1), std::roundf(baseline + glyph->y1) },
+                    { glyph->ux0, glyph->uy0 },
+                    { glyph->ux1, glyph->uy1 },
+                });
+            }
+
+            x += glyph != nullptr ? glyph->AdvanceX : std::roundf(m_font->FontSize * 0.5f);
+            line.CaretX.push_back(x);
+            line.CaretOffsets.push_back(U32(it - textBegin));
+        }
+    }
+
+    void TextBox::shape_all_lines()
+    {
+        m_lines.clear();
+
+        std::size_t lineBegin = 0;
+        const auto size = m_buffer.size();
+        for (std::size_t pos = 0; pos < size; ++pos)
+        {
+            if (m_buffer[pos] == '\n')
+            {
+                m_lines.push_back({ lineBegin, pos - lineBegin });
+                lineBegin = pos + 1;
+            }
+        }
+        m_lines.push_back({ lineBegin, size - lineBegin });
+
+        for (auto& line : m_lines)
+        {
+            shape_line(line);
+        }
+        m_shapedAtlasGeneration = get_current_context()->io.Fonts.get_atlas_generation();
+    }
+
+    auto TextBox::get_line_index(std::size_t offset) const -> std::size_t
+    {
+        const auto it = std::upper_bound(
+            m_lines.begin(), m_lines.end(), offset, [](std::size_t value, const TextLine& line) { return value < line.Begin; });
+        return std::size_t(it - m_lines.begin()) - 1;
+    }
+
+    auto TextBox::get_caret_stop(const TextLine& line, std::size_t offset) const -> std::size_t
+    {
+        const auto it = std::lower_bound(line.CaretOffsets.begin(), line.CaretOffsets.end(), U32(offset - line.Begin));
+        return std::min(std::size_t(it - line.CaretOffsets.begin()), line.CaretOffsets.size() - 1);
+    }
+
+    auto TextBox::get_offset_in_line(const TextLine& line, float x) const -> std::size_t
+    {
+        auto stop = std::size_t(std::lower_bound(line.CaretX.begin(), line.CaretX.end(), x) - line.CaretX.begin());
+        if (stop == line.CaretX.size())
+        {
+            stop = line.CaretX.size() - 1;
+        }
+        else if (stop > 0 && x - line.CaretX[stop - 1] < line.CaretX[stop] - x)
+        {
+            --stop;  // Closer to the previous stop
+        }
+        return line.Begin + line.CaretOffsets[stop];
+    }
+
+    auto TextBox::get_prev_offset(std::size_t offset) const -> std::size_t
+    {
+        const auto lineIdx = get_line_index(offset);
+        const auto& line = m_lines[lineIdx];
+        const auto stop = get_caret_stop(line, offset);
+        if (stop > 0)
+        {
+            return line.Begin + line.CaretOffsets[stop - 1];
+        }
+        return lineIdx > 0 ? line.Begin - 1 : 0;  // The end of the previous line
+    }
+
+    auto TextBox::get_next_offset(std::size_t offset) const -> std::size_t
+    {
+        const auto lineIdx = get_line_index(offset);
+        const auto& line = m_lines[lineIdx];
+        const auto stop = get_caret_stop(line, offset);
+        if (stop + 1 < line.CaretOffsets.size())
+        {
+            return line.Begin + line.CaretOffsets[stop + 1];
+        }
+        return lineIdx + 1 < m_lines.size() ? m_lines[lineIdx + 1].Begin : offset;  // The start of the next line
+    }
+
+    void TextBox::move_caret_line(int direction, bool extendSelection)
+    {
+        const auto lineIdx = get_line_index(m_caret);
+        if ((direction < 0 && lineIdx == 0) || (direction > 0 && lineIdx + 1 >= m_lines.size()))
+        {
+            return;
+        }
+
+        const auto& line = m_lines[lineIdx];
+        const float x = line.CaretX[get_caret_stop(line, m_caret)];
+        set_caret(get_offset_in_line(m_lines[lineIdx + direction], x), extendSelection);
+    }
+
+    bool TextBox::can_patch() const
+    {
+        const auto* context = get_current_context();
+        // Only while the DrawData still holds our slots from the last full render, and nothing moved us since.
+        return !context->dirty && m_renderGeneration == context->drawDataGeneration && m_renderGeneration != 0;
+    }
+
+    void TextBox::patch_caret_and_selection(std::size_t oldFirstLine, std::size_t oldLastLine)
+    {
+        if (!can_patch())
+        {
+            set_dirty();
+            return;
+        }
+
+        auto* context = get_current_context();
+        const auto firstLine = std::min(oldFirstLine, get_line_index(get_selection_begin()));
+        const auto lastLine = std::min(std::max(oldLastLine, get_line_index(get_selection_end())), m_lines.size() - 1);
+        for (auto i = firstLine; i <= lastLine; ++i)
+        {
+            write_selection_quad(context->drawData, i);
+        }
+        write_caret_quad(context->drawData);
+        context->drawDataPatched = true;
+    }
+
+    void TextBox::write_line_quads(DrawData& drawData, std::size_t lineIdx) const
+    {
+        const auto& line = m_lines[lineIdx];
+        const float lineSpacing = m_font != nullptr ? m_font->LineSpacing : 0.0f;
+        const Vec2 lineOrigin = { m_renderOrigin.x, m_renderOrigin.y + float(lineIdx) * lineSpacing };
+        const auto& whitePixelCoords = drawData.WhitePixelUv;
+        const auto color = get_render_color().Int32();
+
+        for (U32 slot = 0; slot < line.GlyphCapacity; ++slot)
+        {
+            const auto quadIdx = line.QuadOffset + 1 + slot;
+            if (slot < line.Glyphs.size())
+            {
+                const auto& glyph = line.Glyphs[slot];
+                drawData.write_textured_rect(quadIdx, lineOrigin + glyph.Min, lineOrigin + glyph.Max, color, glyph.UvMin, glyph.UvMax);
+            }
+            else
+            {
+                drawData.write_textured_rect(quadIdx, lineOrigin, lineOrigin, 0, whitePixelCoords, whitePixelCoords);  // Empty
+            }
+        }
+    }
+
+    void TextBox::write_selection_quad(DrawData& drawData, std::size_t lineIdx) const
+    {
+        const auto& line = m_lines[lineIdx];
+        const float lineSpacing = m_font != nullptr ? m_font->LineSpacing : 0.0f;
+        const Vec2 lineOrigin = { m_renderOrigin.x, m_renderOrigin.y + float(lineIdx) * lineSpacing };
+        const auto& whitePixelCoords = drawData.WhitePixelUv;
+
+        const auto lineEnd = line.Begin + line.Length;
+        const auto selectionBegin = get_selection_begin();
+        const auto selectionEnd = get_selection_end();
+        if (!has_selection() || selectionBegin > lineEnd || selectionEnd <= line.Begin)
+        {
+            drawData.write_textured_rect(line.QuadOffset, lineOrigin, lineOrigin, 0, whitePixelCoords, whitePixelCoords);  // Empty
+            return;
+        }
+
+        const float x0 = line.CaretX[get_caret_stop(line, std::max(selectionBegin, line.Begin))];
+        float x1 = line.CaretX[get_caret_stop(line, std::min(selectionEnd, lineEnd))];
+        if (selectionEnd > lineEnd)
+        {
+            x1 += std::roundf(lineSpacing * 0.25f);  // Show the selected line break
+        }
+
+        const Vec2 selectionTL = { lineOrigin.x + x0, lineOrigin.y };
+        const Vec2 selectionBR = { lineOrigin.x + x1, lineOrigin.y + lineSpacing };
+        drawData.write_textured_rect(line.QuadOffset, selectionTL, selectionBR, m_selectionColor, whitePixelCoords, whitePixelCoords);
+    }
+
+    void TextBox::write_caret_quad(DrawData& drawData) const
+    {
+        const auto& whitePixelCoords = drawData.WhitePixelUv;
+        if (!(get_state() & RETGUI_ELEMENT_STATE_FOCUSED) || m_font == nullptr)
+        {
+            drawData.write_textured_rect(m_caretQuadIdx, m_renderOrigin, m_renderOrigin, 0, whitePixelCoords, whitePixelCoords);  // Empty
+            return;
+        }
+
+        const auto lineIdx = get_line_index(m_caret);
+        const auto& line = m_lines[lineIdx];
+        const Vec2 caretTL = {
+            m_renderOrigin.x + line.CaretX[get_caret_stop(line, m_caret)],
+            m_renderOrigin.y + float(lineIdx) * m_font->LineSpacing,
+        };
+        const Vec2 caretBR = { caretTL.x + 1.0f, caretTL.y + m_font->LineSpacing };
+        drawData.write_textured_rect(m_caretQuadIdx, caretTL, caretBR, m_caretColor, whitePixelCoords, whitePixelCoords);
     }
 
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb_truetype.h>
 
+#include "retgui/retgui.hpp"
+
 #include <fstream>
 
 namespace retgui
@@ -37,9 +39,173 @@ namespace retgui
         return buffer;
     }
 
-    auto Font::calc_text_size(const std::string& text) -> Vec2
+    static void alpha8_to_rgba32(const std::vector<U8>& pixelsU8, std::vector<U32>& outPixels, U32 width, U32 height)
+    {
+        outPixels.resize(width * height * 4);
+        const U8* src = pixelsU8.data();
+        U32* dst = outPixels.data();
+        for (auto i = 0; i < width * height; i++)
+        {
+            *dst = RETGUI_COL32(255, 255, 255, (*src));
+            src++;
+            dst++;
+        }
+    }
+
+    static void set_glyph_atlas_coords(GlyphMetrics& glyph, U32 pageIdx, I32 atlasSize, I32 x, I32 y, I32 w, I32 h)
+    {
+        glyph.Page = pageIdx;
+        // UVs should TL -> BR
+        glyph.ux0 = float(x) / float(atlasSize);
+        glyph.uy0 = float(atlasSize - y) / float(atlasSize);
+        glyph.ux1 = glyph.ux0 + (float(w) / float(atlasSize));
+        glyph.uy1 = glyph.uy0 - (float(h) / float(atlasSize));
+    }
+
+    /*
+     * Prebaked font file layout (native endianness):
+     *   BakedFontHeader
+     *   BakedGlyph[GlyphCount]
+     *   U8[Width * Height]     Alpha8 pixels, top row first.
+     */
+    constexpr U32 BakedFontMagic = 0x46424752;  // "RGBF"
+    constexpr U32 BakedFontVersion = 1;
+
+    struct BakedFontHeader
+    {
+        U32 Magic;
+        U32 Version;
+        float FontSize;
+        float Ascender;
+        float Descender;
+        float LineSpacing;
+        float LineGap;
+        float MaxAdvanceWidth;
+        U32 GlyphCount;
+        U32 Width;
+        U32 Height;
+    };
+
+    auto Font::calc_text_size(const std::string& text) const -> Vec2
+    {
+        // Follows the same pen rules as Label::render()
+        float lineWidth = 0.0f;
+        Vec2 size = { 0.0f, text.empty() ? 0.0f : LineSpacing };
+        utf8_for_each(text.data(), text.data() + text.size(), [&](U32 character) {
+            if (character == '\n')
+            {
+                size.x = std::max(size.x, lineWidth);
+                size.y += LineSpacing;
+                lineWidth = 0.0f;
+                return;
+            }
+
+            auto* glyph = get_glyph(character);
+            if (glyph == nullptr)
+            {
+                glyph = get_glyph('?');
+            }
+            lineWidth += glyph != nullptr ? glyph->AdvanceX : std::roundf(FontSize * 0.5f);
+        });
+        size.x = std::max(size.x, lineWidth);
+        return size;
+    }
+
+    void CharsetBuilder::add_char(U32 codePoint)
+    {
+        if (codePoint > RETGUI_UNICODE_CODEPOINT_MAX)
+        {
+            return;
+        }
+
+        const auto wordIdx = codePoint / 32u;
+        if (wordIdx >= m_usedChars.size())
+        {
+            m_usedChars.resize(wordIdx + 1, 0u);
+        }
+        m_usedChars[wordIdx] |= 1u << (codePoint % 32u);
+    }
+
+    void CharsetBuilder::add_text(const std::string& text)
+    {
+        const char* str = text.data();
+        const char* strEnd = text.data() + text.size();
+        while (str < strEnd)
+        {
+            U32 codePoint{};
+            str += utf8_decode(str, strEnd, codePoint);
+            add_char(codePoint);
+        }
+    }
+
+    void CharsetBuilder::add_ranges(const std::vector<CharsetRange>& charsetRanges)
+    {
+        for (const auto& charsetRange : charsetRanges)
+        {
+            for (std::int32_t i = charsetRange.Begin; i <= charsetRange.End; ++i)
+            {
+                add_char(U32(i));
+            }
+        }
+    }
+
+    bool CharsetBuilder::contains(U32 codePoint) const
+    {
+        const auto wordIdx = codePoint / 32u;
+        if (wordIdx >= m_usedChars.size())
+        {
+            return false;
+        }
+        return (m_usedChars[wordIdx] & (1u << (codePoint % 32u))) != 0;
+    }
+
+    bool CharsetBuilder::empty() const
+    {
+        for (const auto word : m_usedChars)
+        {
+            if (word != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    auto CharsetBuilder::build_ranges() const -> std::vector<CharsetRange>
+    {
+        std::vector<CharsetRange> charsetRanges{};
+        for (U32 wordIdx = 0; wordIdx < m_usedChars.size(); ++wordIdx)
+        {
+            const auto word = m_usedChars[wordIdx];
+            if (word == 0)
+            {
+                continue;
+            }
+
+            for (U32 bit = 0; bit < 32; ++bit)
+            {
+                if (!(word & (1u << bit)))
+                {
+                    continue;
+                }
+
+                const auto codePoint = std::int32_t(wordIdx * 32u + bit);
+                if (!charsetRanges.empty() && charsetRanges.back().End == codePoint - 1)
+                {
+                    charsetRanges.back().End = codePoint;
+                }
+                else
+                {
+                    charsetRanges.push_back({ codePoint, codePoint });
+                }
+            }
+        }
+        return charsetRanges;
+    }
+
+    void CharsetBuilder::clear()
     {
-        return {};
+        m_usedChars.clear();
     }
 
     auto Fonts::add_font_from_file(const std::string& fontFilename, float fontSize, std::vector<CharsetRange> charsetRanges) -> Font*
@@ -52,18 +218,21 @@ namespace retgui
             };
         }
 
-        m_fonts.push_back(std::make_unique<Font>());
-        auto& font = m_fonts.back();
-
-        auto fontData = load_font_data(fontFilename);
+        auto& source = m_fontSources.emplace_back();
+        source.Data = load_font_data(fontFilename);
         stbtt_fontinfo sbttFontInfo{};
-        if (!stbtt_InitFont(&sbttFontInfo, fontData.data(), 0))
+        if (!stbtt_InitFont(&sbttFontInfo, source.Data.data(), 0))
         {
+            m_fontSources.pop_back();
             throw std::runtime_error("Failed to init font.");
         }
 
+        m_fonts.push_back(std::make_unique<Font>());
+        auto& font = m_fonts.back();
+
         font->FontSize = fontSize;
         const auto scale = stbtt_ScaleForPixelHeight(&sbttFontInfo, fontSize);
+        source.Scale = scale;
 
         std::int32_t ascent{};
         std::int32_t descent{};
@@ -75,17 +244,265 @@ namespace retgui
         font->LineGap = std::roundf(float(lineGap) * scale);    // Scale this
         font->LineSpacing = font->Ascender - font->Descender + font->LineGap;
 
+        load_glyphs(m_fonts.size() - 1, charsetRanges);
+
+        return font.get();
+    }
+
+    auto Fonts::add_font_from_baked_file(const std::string& bakedFilename) -> Font*
+    {
+        std::ifstream file(bakedFilename, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open baked font.");
+        }
+
+        BakedFontHeader header{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.Magic != BakedFontMagic || header.Version != BakedFontVersion)
+        {
+            throw std::runtime_error("Invalid baked font file.");
+        }
+
+        // Check the counts against the file size before allocating anything based on them.
+        const auto dataStart = file.tellg();
+        file.seekg(0, std::ios::end);
+        const auto dataSize = std::uint64_t(file.tellg() - dataStart);
+        file.seekg(dataStart);
+        const auto glyphBytes = std::uint64_t(header.GlyphCount) * sizeof(BakedGlyph);
+        const auto pixelBytes = std::uint64_t(header.Width) * header.Height;
+        if (!file || glyphBytes > dataSize || pixelBytes > dataSize - glyphBytes)
+        {
+            throw std::runtime_error("Baked font file is truncated.");
+        }
+
+        std::vector<BakedGlyph> bakedGlyphs(header.GlyphCount);
+        file.read(reinterpret_cast<char*>(bakedGlyphs.data()), std::streamsize(bakedGlyphs.size() * sizeof(BakedGlyph)));
+        std::vector<U8> pixels(std::size_t(header.Width) * header.Height);
+        file.read(reinterpret_cast<char*>(pixels.data()), std::streamsize(pixels.size()));
+        if (!file)
+        {
+            throw std::runtime_error("Baked font file is truncated.");
+        }
+
+        EmbeddedFont bakedFont{ header.FontSize,
+                                header.Ascender,
+                                header.Descender,
+                                header.LineSpacing,
+                                header.LineGap,
+                                header.MaxAdvanceWidth,
+                                bakedGlyphs.data(),
+                                header.GlyphCount,
+                                pixels.data(),
+                                header.Width,
+                                header.Height };
+        auto* font = add_baked_font(std::make_unique<Font>(), bakedFont);
+
+        // Vector moves keep their buffers, so the pointers above stay valid.
+        auto& source = m_fontSources.back();
+        source.OwnedBakedGlyphs = std::move(bakedGlyphs);
+        source.OwnedBakedPixels = std::move(pixels);
+        return font;
+    }
+
+    auto Fonts::add_font_from_embedded(const EmbeddedFont& embeddedFont) -> Font*
+    {
+        return add_baked_font(std::make_unique<Font>(), embeddedFont);
+    }
+
+    void Fonts::save_baked_font(const Font* font, const std::string& bakedFilename) const
+    {
+        std::vector<BakedGlyph> bakedGlyphs{};
+        std::vector<U8> pixels{};
+        U32 width{};
+        U32 height{};
+        bake_font(font, bakedGlyphs, pixels, width, height);
+
+        BakedFontHeader header{};
+        header.Magic = BakedFontMagic;
+        header.Version = BakedFontVersion;
+        header.FontSize = font->FontSize;
+        header.Ascender = font->Ascender;
+        header.Descender = font->Descender;
+        header.LineSpacing = font->LineSpacing;
+        header.LineGap = font->LineGap;
+        header.MaxAdvanceWidth = font->MaxAdvanceWidth;
+        header.GlyphCount = U32(bakedGlyphs.size());
+        header.Width = width;
+        header.Height = height;
+
+        std::ofstream file(bakedFilename, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(bakedGlyphs.data()), std::streamsize(bakedGlyphs.size() * sizeof(BakedGlyph)));
+        file.write(reinterpret_cast<const char*>(pixels.data()), std::streamsize(pixels.size()));
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write baked font.");
+        }
+    }
+
+    auto Fonts::add_baked_font(std::unique_ptr<Font> font, const EmbeddedFont& bakedFont) -> Font*
+    {
+        font->FontSize = bakedFont.FontSize;
+        font->Ascender = bakedFont.Ascender;
+        font->Descender = bakedFont.Descender;
+        font->LineSpacing = bakedFont.LineSpacing;
+        font->LineGap = bakedFont.LineGap;
+        font->MaxAdvanceWidth = bakedFont.MaxAdvanceWidth;
+
+        FontSource source{};
+        for (U32 i = 0; i < bakedFont.GlyphCount; ++i)
+        {
+            const auto& bakedGlyph = bakedFont.Glyphs[i];
+            // 64-bit, so that neither the glyph size nor its far edge can wrap around.
+            const auto glyphWidth = std::int64_t(bakedGlyph.x1) - bakedGlyph.x0;
+            const auto glyphHeight = std::int64_t(bakedGlyph.y1) - bakedGlyph.y0;
+            if (bakedGlyph.CodePoint > RETGUI_UNICODE_CODEPOINT_MAX || glyphWidth < 0 || glyphHeight < 0 ||
+                std::int64_t(bakedGlyph.X) + glyphWidth > bakedFont.Width || std::int64_t(bakedGlyph.Y) + glyphHeight > bakedFont.Height)
+            {
+                throw std::runtime_error("Invalid baked glyph.");
+            }
+
+            if (bakedGlyph.CodePoint >= font->glyphs.size())
+            {
+                font->glyphs.resize(bakedGlyph.CodePoint + 1);
+            }
+            auto& glyph = font->glyphs[bakedGlyph.CodePoint];
+            glyph.x0 = bakedGlyph.x0;
+            glyph.y0 = bakedGlyph.y0;
+            glyph.x1 = bakedGlyph.x1;
+            glyph.y1 = bakedGlyph.y1;
+            glyph.AdvanceX = bakedGlyph.AdvanceX;
+            source.LoadedChars.add_char(bakedGlyph.CodePoint);
+        }
+
+        source.Baked = bakedFont;
+        m_fontSources.push_back(std::move(source));
+        m_fonts.push_back(std::move(font));
+        m_atlasDirty = true;
+        return m_fonts.back().get();
+    }
+
+    void Fonts::bake_font(const Font* font, std::vector<BakedGlyph>& outGlyphs, std::vector<U8>& outPixels, U32& outWidth, U32& outHeight)
+        const
+    {
+        const auto fontIdx = get_font_index(font);
+        if (fontIdx < 0 || m_fontSources[fontIdx].Data.empty())
+        {
+            throw std::runtime_error("Only fonts loaded from a font file can be baked.");
+        }
+        const auto& source = m_fontSources[fontIdx];
+
+        stbtt_fontinfo sbttFontInfo{};
+        stbtt_InitFont(&sbttFontInfo, source.Data.data(), 0);
+
+        outGlyphs.clear();
+        std::vector<stbrp_rect> packedRects{};
+        for (const auto& charsetRange : source.LoadedChars.build_ranges())
+        {
+            for (std::int32_t i = charsetRange.Begin; i <= charsetRange.End; ++i)
+            {
+                const auto& glyph = font->glyphs[i];
+                outGlyphs.push_back({ U32(i), glyph.x0, glyph.y0, glyph.x1, glyph.y1, glyph.AdvanceX, 0, 0 });
+
+                auto& packedRect = packedRects.emplace_back();
+                packedRect.id = I32(packedRects.size() - 1);
+                packedRect.w = glyph.x1 - glyph.x0;
+                packedRect.h = glyph.y1 - glyph.y0;
+            }
+        }
+
+        const auto maxPageSize = I32(m_maxPageSize);
+        auto bitmapSize = std::min(64, maxPageSize);
+        stbrp_context rpContext{};
+        std::vector<stbrp_node> nodes{};
+        while (true)
+        {
+            nodes.assign(bitmapSize, {});
+            stbrp_init_target(&rpContext, bitmapSize, bitmapSize, nodes.data(), nodes.size());
+            if (stbrp_pack_rects(&rpContext, packedRects.data(), packedRects.size()))
+            {
+                break;
+            }
+            if (bitmapSize >= maxPageSize)
+            {
+                throw std::runtime_error("Font does not fit into the maximum atlas page size.");
+            }
+            bitmapSize = std::min(NextPowerOf2(bitmapSize), maxPageSize);
+        }
+
+        outWidth = bitmapSize;
+        outHeight = bitmapSize;
+        outPixels.assign(bitmapSize * bitmapSize, 0);
+        for (const auto& packedRect : packedRects)
+        {
+            auto& bakedGlyph = outGlyphs[packedRect.id];
+            bakedGlyph.X = packedRect.x;
+            bakedGlyph.Y = packedRect.y;
+            if (packedRect.w > 0 && packedRect.h > 0)
+            {
+                auto* output = outPixels.data() + packedRect.x + packedRect.y * bitmapSize;
+                stbtt_MakeCodepointBitmap(
+                    &sbttFontInfo, output, packedRect.w, packedRect.h, bitmapSize, source.Scale, source.Scale, bakedGlyph.CodePoint);
+            }
+        }
+    }
+
+    bool Fonts::add_glyphs(Font* font, const std::vector<CharsetRange>& charsetRanges)
+    {
+        const auto fontIdx = get_font_index(font);
+        if (fontIdx < 0)
+        {
+            throw std::runtime_error("Font does not belong to this atlas.");
+        }
+        if (m_fontSources[fontIdx].Data.empty())
+        {
+            throw std::runtime_error("Glyphs can only be added to fonts loaded from a font file.");
+        }
+
+        return load_glyphs(U32(fontIdx), charsetRanges);
+    }
+
+    auto Fonts::get_font_index(const Font* font) const -> I32
+    {
+        for (std::size_t i = 0; i < m_fonts.size(); ++i)
+        {
+            if (m_fonts[i].get() == font)
+            {
+                return I32(i);
+            }
+        }
+        return -1;
+    }
+
+    bool Fonts::load_glyphs(U32 fontIdx, const std::vector<CharsetRange>& charsetRanges)
+    {
+        auto& font = m_fonts[fontIdx];
+        auto& source = m_fontSources[fontIdx];
+
+        stbtt_fontinfo sbttFontInfo{};
+        stbtt_InitFont(&sbttFontInfo, source.Data.data(), 0);
+        const auto scale = source.Scale;
+
         std::int32_t highestGlyph{};
         for (const auto& charsetRange : charsetRanges)
         {
             highestGlyph = std::max(highestGlyph, charsetRange.End);
         }
-        font->glyphs.resize(highestGlyph + 1);
+        if (std::size_t(highestGlyph) + 1 > font->glyphs.size())
+        {
+            font->glyphs.resize(highestGlyph + 1);
+        }
 
+        bool addedGlyphs = false;
         for (const auto& charsetRange : charsetRanges)
         {
             for (std::int32_t i = charsetRange.Begin; i <= charsetRange.End; ++i)
             {
+                if (source.LoadedChars.contains(i))
+                {
+                    continue;
+                }
                 if (!stbtt_FindGlyphIndex(&sbttFontInfo, i))
                 {
                     // Codepoint/Glyph is not in the font.
@@ -103,137 +520,354 @@ namespace retgui
                 // Get glyph bounding box (might be offset for chars that dip above/below the line)
                 stbtt_GetCodepointBitmapBox(&sbttFontInfo, i, scale, scale, &glyph.x0, &glyph.y0, &glyph.x1, &glyph.y1);
 
-                std::int32_t bitmapWidth{};
-                std::int32_t bitmapHeight{};
-                std::int32_t xOffset{};
-                std::int32_t yOffset{};
-                auto* bitmap = stbtt_GetCodepointBitmap(&sbttFontInfo, scale, scale, i, &bitmapWidth, &bitmapHeight, &xOffset, &yOffset);
-
-                auto& charToPack = m_fontCharsToPack.emplace_back();
-                charToPack.FontIdx = m_fonts.size() - 1;
-                charToPack.CodePoint = i;
-                charToPack.Bitmap = bitmap;
-                charToPack.Width = bitmapWidth;
-                charToPack.Height = bitmapHeight;
+                source.LoadedChars.add_char(i);
+                addedGlyphs = true;
             }
         }
 
-        return font.get();
+        m_atlasDirty |= addedGlyphs;
+        return addedGlyphs;
     }
 
-    void Fonts::get_texture_data_as_alpha8(std::vector<U8>& outPixels, U32& outWidth, U32& outHeight)
+    void Fonts::build_atlas()
     {
-        std::vector<stbrp_rect> packedRects{};
-
-        for (auto i = 0; i < m_fontCharsToPack.size(); ++i)
+        // Glyphs are packed from their bounding boxes, then rasterized straight into their place in the atlas.
+        struct FontCharToPack
+        {
+            U32 FontIdx{};
+            U32 CodePoint{};
+            bool IsBakedBitmap{};  // The whole bitmap of a prebaked font, which is copied instead of rasterized.
+        };
+        std::vector<FontCharToPack> fontCharsToPack{};
+        std::vector<stbrp_rect> rectsToPack{};
+        std::vector<stbtt_fontinfo> fontInfos(m_fontSources.size());
+        for (auto fontIdx = 0; fontIdx < m_fontSources.size(); ++fontIdx)
         {
-            const auto& fontCharToPack = m_fontCharsToPack[i];
+            const auto& source = m_fontSources[fontIdx];
+            if (source.Baked.Pixels != nullptr)
+            {
+                auto& packedRect = rectsToPack.emplace_back();
+                packedRect.id = I32(fontCharsToPack.size());
+                packedRect.w = I32(source.Baked.Width);
+                packedRect.h = I32(source.Baked.Height);
 
-            auto& packedRect = packedRects.emplace_back();
-            packedRect.id = i;
-            packedRect.w = fontCharToPack.Width;
-            packedRect.h = fontCharToPack.Height;
-        }
+                fontCharsToPack.push_back({ U32(fontIdx), 0, true });
+                continue;
+            }
+            if (source.Data.empty())
+            {
+                continue;
+            }
+            stbtt_InitFont(&fontInfos[fontIdx], source.Data.data(), 0);
 
-        // Add white pixels
-        {
-            auto& packedWhitePixels = packedRects.emplace_back();
-            packedWhitePixels.w = WhitePixelSize;
-            packedWhitePixels.h = WhitePixelSize;
+            const auto& font = m_fonts[fontIdx];
+            for (const auto& charsetRange : source.LoadedChars.build_ranges())
+            {
+                for (std::int32_t i = charsetRange.Begin; i <= charsetRange.End; ++i)
+                {
+                    const auto& glyph = font->glyphs[i];
+
+                    auto& packedRect = rectsToPack.emplace_back();
+                    packedRect.id = I32(fontCharsToPack.size());
+                    packedRect.w = glyph.x1 - glyph.x0;
+                    packedRect.h = glyph.y1 - glyph.y0;
+
+                    fontCharsToPack.push_back({ U32(fontIdx), U32(i), false });
+                }
+            }
         }
 
-        auto atlasWidth = 128;
-        auto atlasHeight = 128;
-        stbrp_context rpContext{};
-        std::vector<stbrp_node> nodes(NextPowerOf2(atlasWidth));
-        stbrp_init_target(&rpContext, atlasWidth, atlasHeight, nodes.data(), nodes.size());
-        while (!stbrp_pack_rects(&rpContext, packedRects.data(), packedRects.size()))
+        stbrp_rect packedWhitePixels{};
+        packedWhitePixels.w = WhitePixelSize;
+        packedWhitePixels.h = WhitePixelSize;
+
+        // Keep the texture ids of pages that still exist, so backends can re-upload into them.
+        std::vector<TexId> pageTextures{};
+        for (const auto& page : m_pages)
         {
-            atlasWidth = NextPowerOf2(atlasWidth);
-            atlasHeight = NextPowerOf2(atlasHeight);
-            nodes.assign(NextPowerOf2(atlasWidth), {});
-            stbrp_init_target(&rpContext, atlasWidth, atlasHeight, nodes.data(), nodes.size());
+            pageTextures.push_back(page.Texture);
         }
+        m_pages.clear();
 
-        outWidth = atlasWidth;
-        outHeight = atlasHeight;
-        outPixels = std::vector<U8>(atlasWidth * atlasHeight, 0);
-        for (auto i = 0; i < m_fontCharsToPack.size(); ++i)
+        const auto maxPageSize = I32(m_maxPageSize);
+        while (m_pages.empty() || !rectsToPack.empty())
         {
-            const auto& packedFontChar = m_fontCharsToPack[i];
-            const auto& packedRect = packedRects[i];
+            const bool isFirstPage = m_pages.empty();
+
+            // Grow the page until everything fits, or spill what doesn't fit at the maximum size into another page.
+            auto atlasSize = std::min(128, maxPageSize);
+            stbrp_context rpContext{};
+            std::vector<stbrp_node> nodes{};
+            while (true)
+            {
+                nodes.assign(atlasSize, {});
+                stbrp_init_target(&rpContext, atlasSize, atlasSize, nodes.data(), nodes.size());
+                if (isFirstPage)
+                {
+                    // The white pixels always live on the first page.
+                    stbrp_pack_rects(&rpContext, &packedWhitePixels, 1);
+                }
+                if (stbrp_pack_rects(&rpContext, rectsToPack.data(), rectsToPack.size()) || atlasSize >= maxPageSize)
+                {
+                    break;
+                }
+                atlasSize = std::min(NextPowerOf2(atlasSize), maxPageSize);
+            }
 
-            auto& font = m_fonts[packedFontChar.FontIdx];
-            auto& glyph = font->glyphs[packedFontChar.CodePoint];
-            // UVs should TL -> BR
-            glyph.ux0 = float(packedRect.x) / float(atlasWidth);
-            glyph.uy0 = float(atlasHeight - packedRect.y) / float(atlasHeight);
-            glyph.ux1 = glyph.ux0 + (float(packedRect.w) / float(atlasWidth));
-            glyph.uy1 = glyph.uy0 - (float(packedRect.h) / float(atlasHeight));
+            const auto pageIdx = U32(m_pages.size());
+            auto& page = m_pages.emplace_back();
+            page.Width = atlasSize;
+            page.Height = atlasSize;
+            page.Pixels.assign(atlasSize * atlasSize, 0);
+            page.Texture = pageIdx < pageTextures.size() ? pageTextures[pageIdx] : TexId{};
 
-            for (int y = 0; y < packedRect.h; ++y)
+            std::vector<stbrp_rect> unpackedRects{};
+            for (const auto& packedRect : rectsToPack)
             {
-                for (int x = 0; x < packedRect.w; ++x)
+                if (!packedRect.was_packed)
                 {
-                    auto atlasIndex = (packedRect.x + x) + (packedRect.y + y) * atlasWidth;
-                    outPixels[atlasIndex] = packedFontChar.Bitmap[x + y * packedRect.w];
+                    unpackedRects.push_back(packedRect);
+                    continue;
+                }
+
+                const auto& packedFontChar = fontCharsToPack[packedRect.id];
+                auto& font = m_fonts[packedFontChar.FontIdx];
+                const auto& source = m_fontSources[packedFontChar.FontIdx];
+                if (packedFontChar.IsBakedBitmap)
+                {
+                    const auto& baked = source.Baked;
+                    for (U32 y = 0; y < baked.Height; ++y)
+                    {
+                        const auto* srcRow = baked.Pixels + y * baked.Width;
+                        std::copy(srcRow, srcRow + baked.Width, page.Pixels.data() + packedRect.x + (packedRect.y + y) * atlasSize);
+                    }
+                    for (U32 i = 0; i < baked.GlyphCount; ++i)
+                    {
+                        const auto& bakedGlyph = baked.Glyphs[i];
+                        auto& glyph = font->glyphs[bakedGlyph.CodePoint];
+                        set_glyph_atlas_coords(glyph,
+                                               pageIdx,
+                                               atlasSize,
+                                               packedRect.x + I32(bakedGlyph.X),
+                                               packedRect.y + I32(bakedGlyph.Y),
+                                               glyph.x1 - glyph.x0,
+                                               glyph.y1 - glyph.y0);
+                    }
+                    continue;
+                }
+
+                auto& glyph = font->glyphs[packedFontChar.CodePoint];
+                set_glyph_atlas_coords(glyph, pageIdx, atlasSize, packedRect.x, packedRect.y, packedRect.w, packedRect.h);
+
+                if (packedRect.w > 0 && packedRect.h > 0)
+                {
+                    auto* output = page.Pixels.data() + packedRect.x + packedRect.y * atlasSize;
+                    stbtt_MakeCodepointBitmap(&fontInfos[packedFontChar.FontIdx],
+                                              output,
+                                              packedRect.w,
+                                              packedRect.h,
+                                              atlasSize,
+                                              source.Scale,
+                                              source.Scale,
+                                              packedFontChar.CodePoint);
                 }
             }
 
-            stbtt_FreeBitmap(packedFontChar.Bitmap, nullptr);
-        }
+            if (isFirstPage)
+            {
+                if (!packedWhitePixels.was_packed)
+                {
+                    throw std::runtime_error("Maximum atlas page size is too small for the white pixels.");
+                }
+                for (int y = 0; y < packedWhitePixels.h; ++y)
+                {
+                    for (int x = 0; x < packedWhitePixels.w; ++x)
+                    {
+                        auto atlasIndex = (packedWhitePixels.x + x) + (packedWhitePixels.y + y) * atlasSize;
+                        page.Pixels[atlasIndex] = 255;  // White
+                    }
+                }
 
-        // Add white pixels
-        {
-            const auto& packedWhitePixels = packedRects.back();
-            for (int y = 0; y < packedWhitePixels.h; ++y)
+                m_whitePixelCoords = {
+                    (float(packedWhitePixels.x) + float(packedWhitePixels.w) * 0.5f) / float(atlasSize),
+                    (float(atlasSize - packedWhitePixels.y) - float(packedWhitePixels.h) * 0.5f) / float(atlasSize),
+                };
+            }
+            else if (unpackedRects.size() == rectsToPack.size())
+            {
+                throw std::runtime_error("Glyph does not fit into the maximum atlas page size.");
+            }
+            rectsToPack = std::move(unpackedRects);
+
+            // Flip atlas pixels vertically
+            for (auto y = 0; y < atlasSize / 2; ++y)
             {
-                for (int x = 0; x < packedWhitePixels.w; ++x)
+                for (auto x = 0; x < atlasSize; ++x)
                 {
-                    auto atlasIndex = (packedWhitePixels.x + x) + (packedWhitePixels.y + y) * atlasWidth;
-                    outPixels[atlasIndex] = 255;  // White
+                    auto temp = page.Pixels[x + y * atlasSize];
+                    page.Pixels[x + y * atlasSize] = page.Pixels[x + ((atlasSize - 1) * atlasSize) - y * atlasSize];
+                    page.Pixels[x + ((atlasSize - 1) * atlasSize) - y * atlasSize] = temp;
                 }
             }
+        }
 
-            m_whitePixelCoords = {
-                (float(packedWhitePixels.x) + float(packedWhitePixels.w) * 0.5f) / float(atlasWidth),
-                (float(atlasHeight - packedWhitePixels.y) + float(packedWhitePixels.h) * 0.5f) / float(atlasHeight),
-            };
+        m_atlasBuilt = true;
+        m_atlasDirty = false;
+        m_atlasGeneration++;
+    }
+
+    void Fonts::get_texture_data_as_alpha8(std::vector<U8>& outPixels, U32& outWidth, U32& outHeight, U32 page)
+    {
+        if (!m_atlasBuilt || m_atlasDirty)
+        {
+            build_atlas();
         }
 
-        // Flip atlas pixels vertically
-        for (auto y = 0; y < atlasHeight / 2; ++y)
+        if (page >= m_pages.size())
         {
-            for (auto x = 0; x < atlasWidth; ++x)
-            {
-                auto temp = outPixels[x + y * atlasWidth];
-                outPixels[x + y * atlasWidth] = outPixels[x + ((atlasHeight - 1) * atlasWidth) - y * atlasWidth];
-                outPixels[x + ((atlasHeight - 1) * atlasWidth) - y * atlasWidth] = temp;
-            }
+            outPixels.clear();
+            outWidth = 0;
+            outHeight = 0;
+            return;
         }
+
+        const auto& atlasPage = m_pages[page];
+        outPixels = atlasPage.Pixels;
+        outWidth = atlasPage.Width;
+        outHeight = atlasPage.Height;
     }
 
-    void Fonts::get_texture_data_as_rgba32(std::vector<U32>& outPixels, U32& outWidth, U32& outHeight)
+    void Fonts::get_texture_data_as_rgba32(std::vector<U32>& outPixels, U32& outWidth, U32& outHeight, U32 page)
     {
         std::vector<U8> pixelsU8;
-        get_texture_data_as_alpha8(pixelsU8, outWidth, outHeight);
+        get_texture_data_as_alpha8(pixelsU8, outWidth, outHeight, page);
         if (!pixelsU8.empty())
         {
-            outPixels.resize(outWidth * outHeight * 4);
-            const U8* src = pixelsU8.data();
-            U32* dst = outPixels.data();
-            for (auto i = 0; i < outWidth * outHeight; i++)
+            alpha8_to_rgba32(pixelsU8, outPixels, outWidth, outHeight);
+        }
+    }
+
+    auto Fonts::get_tex_id(U32 page) const -> TexId
+    {
+        if (page >= m_pages.size())
+        {
+            return {};
+        }
+        return m_pages[page].Texture;
+    }
+
+    void Fonts::set_tex_id(TexId texture, U32 page)
+    {
+        if (page >= m_pages.size())
+        {
+            throw std::runtime_error("Atlas page does not exist.");
+        }
+        m_pages[page].Texture = texture;
+    }
+
+    void Fonts::set_max_page_size(U32 maxPageSize)
+    {
+        m_maxPageSize = maxPageSize;
+        m_atlasDirty = true;
+    }
+
+    auto Fonts::add_fonts_async(const std::vector<FontRequest>& requests) -> AsyncFontBuild
+    {
+        if (m_asyncBuild.valid())
+        {
+            throw std::runtime_error("An async font build is already in progress.");
+        }
+
+        AsyncFontBuild build{};
+        m_asyncFonts.clear();
+        for (const auto& request : requests)
+        {
+            // Approximate the metrics so layout is stable until the real font arrives.
+            auto& font = m_fonts.emplace_back(std::make_unique<Font>());
+            font->FontSize = request.FontSize;
+            font->Ascender = std::roundf(request.FontSize * 0.8f);
+            font->Descender = -std::roundf(request.FontSize * 0.2f);
+            font->LineSpacing = font->Ascender - font->Descender;
+            font->MaxAdvanceWidth = request.FontSize;
+            m_fontSources.emplace_back();
+            m_asyncFonts.push_back(font.get());
+        }
+        build.Fonts = m_asyncFonts;
+
+        auto readyPromise = std::make_shared<std::promise<void>>();
+        build.Ready = readyPromise->get_future().share();
+        m_asyncReady = build.Ready;
+
+        m_asyncBuild = std::async(std::launch::async, [requests, readyPromise, maxPageSize = m_maxPageSize]() {
+            auto builder = std::make_unique<Fonts>();
+            builder->m_maxPageSize = maxPageSize;
+            try
             {
-                *dst = RETGUI_COL32(255, 255, 255, (*src));
-                src++;
-                dst++;
+                for (const auto& request : requests)
+                {
+                    builder->add_font_from_file(request.Filename, request.FontSize, request.CharsetRanges);
+                }
+                builder->build_atlas();
             }
-        }
+            catch (...)
+            {
+                readyPromise->set_exception(std::current_exception());
+                throw;
+            }
+            readyPromise->set_value();
+            return builder;
+        });
+
+        return build;
+    }
+
+    bool Fonts::is_async_build_ready() const
+    {
+        // Polls the same future as AsyncFontBuild::Ready, so a build is ready here as soon as it is there.
+        return m_asyncBuild.valid() && m_asyncReady.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
     }
 
-    void Fonts::set_tex_id(TexId texture)
+    bool Fonts::apply_async_build()
     {
-        m_texture = texture;
+        if (!is_async_build_ready())
+        {
+            return false;
+        }
+
+        auto builder = m_asyncBuild.get();  // Rethrows any error from the worker. Only waits for the worker to return the result.
+        m_asyncReady = {};
+
+        // The worker's pages only hold the async fonts, so they are appended as they are and nothing is packed or rasterized here.
+        const auto firstPage = U32(m_pages.size());
+        for (std::size_t i = 0; i < m_asyncFonts.size(); ++i)
+        {
+            const auto fontIdx = get_font_index(m_asyncFonts[i]);
+            *m_fonts[fontIdx] = std::move(*builder->m_fonts[i]);
+            m_fontSources[fontIdx] = std::move(builder->m_fontSources[i]);
+            for (auto& glyph : m_fonts[fontIdx]->glyphs)
+            {
+                glyph.Page += firstPage;
+            }
+        }
+        m_asyncFonts.clear();
+
+        if (m_pages.empty())
+        {
+            // Fonts that are still missing from the atlas keep it dirty, so they are packed with everything on the next build.
+            m_whitePixelCoords = builder->m_whitePixelCoords;
+            m_atlasBuilt = true;
+        }
+        for (auto& page : builder->m_pages)
+        {
+            m_pages.push_back(std::move(page));
+        }
+        m_atlasGeneration++;
+
+        if (get_current_context() != nullptr)
+        {
+            set_dirty();
+        }
+        return true;
     }
 
 }
\ No newline at end of file
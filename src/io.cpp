@@ -6,6 +6,14 @@
 
 namespace retgui
 {
+    void IO::add_key_pressed(Key key)
+    {
+        inputEvents.push_back({ key, 0 });
+    }
 
+    void IO::add_input_character(U32 character)
+    {
+        inputEvents.push_back({ Key::None, character });
+    }
 
-}
\ No newline at end of file
+}
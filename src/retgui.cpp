@@ -1,6 +1,8 @@
 #include "retgui/retgui.hpp"
 #include "retgui/internal.hpp"
 
+#include <algorithm>
+
 namespace retgui
 {
     RetGuiContext* g_retGui{ nullptr };  // NOLINT
@@ -49,11 +51,34 @@ namespace retgui
 
     void set_root_size(std::uint32_t width, std::uint32_t height)
     {
+        if (g_retGui->displaySize.x == float(width) && g_retGui->displaySize.y == float(height))
+        {
+            return;  // Usually called every frame
+        }
+
         g_retGui->displaySize = { float(width), float(height) };
         g_retGui->root->set_size(Dim2{ Dim{ 0.0f, float(width) }, Dim{ 0.0f, float(height) } });
         g_retGui->dirty = true;
     }
 
+    void set_draw_output(DrawOutput output)
+    {
+        g_retGui->drawOutput = output;
+        g_retGui->dirty = true;
+    }
+
+    void set_draw_batching(bool enabled)
+    {
+        g_retGui->drawBatching = enabled;
+        g_retGui->dirty = true;
+    }
+
+    void set_draw_data_shrink_policy(std::uint32_t frames, float threshold)
+    {
+        g_retGui->drawDataShrinkFrames = frames;
+        g_retGui->drawDataShrinkThreshold = threshold;
+    }
+
     void set_dirty()
     {
         g_retGui->dirty = true;
@@ -79,11 +104,43 @@ namespace retgui
             update_element(child.get());
             child = child->get_next_sibling();
         }
+
+        auto& io = g_retGui->io;
+        if (g_retGui->focusedElement != nullptr)
+        {
+            for (const auto& event : io.inputEvents)
+            {
+                if (event.PressedKey != Key::None)
+                {
+                    g_retGui->focusedElement->on_key_pressed(event.PressedKey);
+                }
+                else
+                {
+                    g_retGui->focusedElement->on_text_input(event.Character);
+                }
+            }
+        }
+        io.inputEvents.clear();
+    }
+
+    void notify_atlas_rebuilt(Element* element)
+    {
+        element->on_atlas_rebuilt();
+
+        auto child = element->get_first_child();
+        while (child != nullptr)
+        {
+            notify_atlas_rebuilt(child.get());
+            child = child->get_next_sibling();
+        }
     }
 
     void render_element(const Element* element)
     {
-        element->render(g_retGui->drawData);
+        auto& drawData = g_retGui->drawData;
+        element->begin_layer(drawData);
+        drawData.begin_unit();
+        element->render(drawData);
 
         auto child = element->get_first_child();
         while (child != nullptr)
@@ -91,17 +148,58 @@ namespace retgui
             render_element(child.get());
             child = child->get_next_sibling();
         }
+        element->end_layer(drawData);
+    }
+
+    void shrink_draw_data()
+    {
+        auto* drawData = &g_retGui->drawData;
+        const auto usage = drawData->get_usage();
+        const auto capacityBytes = drawData->get_capacity().get_bytes();
+        if (float(usage.get_bytes()) >= float(capacityBytes) * g_retGui->drawDataShrinkThreshold)
+        {
+            g_retGui->drawDataFramesBelowThreshold = 0;
+            g_retGui->drawDataPeakUsage = {};
+            return;
+        }
+
+        auto& peak = g_retGui->drawDataPeakUsage;
+        peak.DrawCmds = std::max(peak.DrawCmds, usage.DrawCmds);
+        peak.Vertices = std::max(peak.Vertices, usage.Vertices);
+        peak.Indices = std::max(peak.Indices, usage.Indices);
+        peak.Quads = std::max(peak.Quads, usage.Quads);
+
+        if (++g_retGui->drawDataFramesBelowThreshold >= g_retGui->drawDataShrinkFrames)
+        {
+            drawData->shrink(peak);
+            g_retGui->drawDataFramesBelowThreshold = 0;
+            peak = {};
+        }
     }
 
     bool render()
     {
+        // A rebuilt atlas moves the glyphs, so everything showing text has to be rendered again.
+        const auto atlasGeneration = g_retGui->io.Fonts.get_atlas_generation();
+        if (atlasGeneration != g_retGui->renderedAtlasGeneration)
+        {
+            g_retGui->renderedAtlasGeneration = atlasGeneration;
+            notify_atlas_rebuilt(g_retGui->root.get());
+            g_retGui->dirty = true;
+        }
+
         if (!g_retGui->dirty)
         {
-            return false;
+            const bool patched = g_retGui->drawDataPatched;
+            g_retGui->drawDataPatched = false;
+            return patched;
         }
 
         auto* drawData = &g_retGui->drawData;
-        *drawData = DrawData{};
+        drawData->clear();
+        drawData->Output = g_retGui->drawOutput;
+        drawData->WhitePixelUv = g_retGui->io.Fonts.get_white_pixel_coords();
+        g_retGui->drawDataGeneration++;
         auto child = g_retGui->root->get_first_child();
         while (child != nullptr)
         {
@@ -109,11 +207,14 @@ namespace retgui
             child = child->get_next_sibling();
         }
 
-        if (!drawData->DrawCmds.empty())
+        drawData->close_draw_cmd();
+        if (g_retGui->drawBatching)
         {
-            drawData->DrawCmds.back().IndexCount = drawData->IndexBuffer.size() - drawData->DrawCmds.back().IndexOffset;
+            drawData->batch_draw_cmds();
         }
+        shrink_draw_data();
 
+        g_retGui->drawDataPatched = false;
         g_retGui->dirty = false;
         return true;
     }
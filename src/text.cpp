@@ -0,0 +1,95 @@
+#include "retgui/text.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace retgui
+{
+    GapBuffer::GapBuffer(const std::string& text)
+    {
+        assign(text);
+    }
+
+    void GapBuffer::insert(std::size_t pos, const char* text, std::size_t length)
+    {
+        if (length == 0)
+        {
+            return;
+        }
+
+        move_gap(pos);
+        if (m_gapEnd - m_gapBegin < length)
+        {
+            grow_gap(length);
+        }
+
+        std::memcpy(m_buffer.data() + m_gapBegin, text, length);
+        m_gapBegin += length;
+    }
+
+    void GapBuffer::erase(std::size_t pos, std::size_t length)
+    {
+        length = std::min(length, size() - pos);
+        move_gap(pos);
+        m_gapEnd += length;
+    }
+
+    auto GapBuffer::substr(std::size_t pos, std::size_t length) const -> std::string
+    {
+        length = std::min(length, size() - pos);
+
+        std::string result(length, '\0');
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            result[i] = (*this)[pos + i];
+        }
+        return result;
+    }
+
+    auto GapBuffer::str() const -> std::string
+    {
+        std::string result(m_buffer.begin(), m_buffer.begin() + std::ptrdiff_t(m_gapBegin));
+        result.append(m_buffer.begin() + std::ptrdiff_t(m_gapEnd), m_buffer.end());
+        return result;
+    }
+
+    void GapBuffer::assign(const std::string& text)
+    {
+        m_buffer.assign(text.begin(), text.end());
+        m_gapBegin = m_gapEnd = m_buffer.size();
+    }
+
+    void GapBuffer::clear()
+    {
+        m_buffer.clear();
+        m_gapBegin = m_gapEnd = 0;
+    }
+
+    void GapBuffer::move_gap(std::size_t pos)
+    {
+        if (pos < m_gapBegin)
+        {
+            const auto count = m_gapBegin - pos;
+            std::memmove(m_buffer.data() + m_gapEnd - count, m_buffer.data() + pos, count);
+            m_gapBegin -= count;
+            m_gapEnd -= count;
+        }
+        else if (pos > m_gapBegin)
+        {
+            const auto count = pos - m_gapBegin;
+            std::memmove(m_buffer.data() + m_gapBegin, m_buffer.data() + m_gapEnd, count);
+            m_gapBegin += count;
+            m_gapEnd += count;
+        }
+    }
+
+    void GapBuffer::grow_gap(std::size_t minLength)
+    {
+        const auto tailLength = m_buffer.size() - m_gapEnd;
+        const auto newSize = std::max(m_buffer.size() * 2, size() + minLength + 64);
+
+        m_buffer.resize(newSize);
+        std::memmove(m_buffer.data() + newSize - tailLength, m_buffer.data() + m_gapEnd, tailLength);
+        m_gapEnd = newSize - tailLength;
+    }
+}
@@ -4,6 +4,16 @@
 #include "retgui/io.hpp"
 #include "retgui/internal.hpp"
 
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define RETGUI_ENABLE_SSE2
+#endif
+
 namespace retgui
 {
     auto ColorToUInt32(float r, float g, float b, float a) -> U32
@@ -15,6 +25,104 @@ namespace retgui
         return RETGUI_COL32(red, green, blue, alpha);
     }
 
+    auto utf8_decode(const char* text, const char* textEnd, U32& outCodePoint) -> I32
+    {
+        static const U8 lengths[32] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 3, 3, 4, 0 };
+        static const U32 masks[5] = { 0x00, 0x7f, 0x1f, 0x0f, 0x07 };
+        static const U32 mins[5] = { 0x400000, 0, 0x80, 0x800, 0x10000 };
+
+        const auto* bytes = reinterpret_cast<const U8*>(text);
+        const I32 length = lengths[bytes[0] >> 3u];
+        if (length == 0 || text + length > textEnd)
+        {
+            outCodePoint = RETGUI_UNICODE_CODEPOINT_INVALID;
+            return 1;
+        }
+
+        U32 codePoint = bytes[0] & masks[length];
+        for (I32 i = 1; i < length; ++i)
+        {
+            if ((bytes[i] & 0xc0u) != 0x80u)
+            {
+                outCodePoint = RETGUI_UNICODE_CODEPOINT_INVALID;
+                return i;
+            }
+            codePoint = (codePoint << 6u) | (bytes[i] & 0x3fu);
+        }
+
+        // Reject overlong encodings, surrogates and out of range values.
+        if (codePoint < mins[length] || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > RETGUI_UNICODE_CODEPOINT_MAX)
+        {
+            codePoint = RETGUI_UNICODE_CODEPOINT_INVALID;
+        }
+        outCodePoint = codePoint;
+        return length;
+    }
+
+    auto utf8_encode(U32 codePoint, char* outText) -> I32
+    {
+        if (codePoint > RETGUI_UNICODE_CODEPOINT_MAX || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        {
+            codePoint = RETGUI_UNICODE_CODEPOINT_INVALID;
+        }
+
+        if (codePoint < 0x80)
+        {
+            outText[0] = char(codePoint);
+            return 1;
+        }
+        if (codePoint < 0x800)
+        {
+            outText[0] = char(0xC0 | (codePoint >> 6));
+            outText[1] = char(0x80 | (codePoint & 0x3F));
+            return 2;
+        }
+        if (codePoint < 0x10000)
+        {
+            outText[0] = char(0xE0 | (codePoint >> 12));
+            outText[1] = char(0x80 | ((codePoint >> 6) & 0x3F));
+            outText[2] = char(0x80 | (codePoint & 0x3F));
+            return 3;
+        }
+        outText[0] = char(0xF0 | (codePoint >> 18));
+        outText[1] = char(0x80 | ((codePoint >> 12) & 0x3F));
+        outText[2] = char(0x80 | ((codePoint >> 6) & 0x3F));
+        outText[3] = char(0x80 | (codePoint & 0x3F));
+        return 4;
+    }
+
+    auto utf8_ascii_run_length(const char* text, const char* textEnd) -> std::size_t
+    {
+        const char* str = text;
+#ifdef RETGUI_ENABLE_SSE2
+        while (textEnd - str >= 16)
+        {
+            const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str));
+            if (_mm_movemask_epi8(chunk) != 0)
+            {
+                break;  // A non-ASCII byte is within the next 16
+            }
+            str += 16;
+        }
+#else
+        while (textEnd - str >= 8)
+        {
+            std::uint64_t chunk{};
+            std::memcpy(&chunk, str, sizeof(chunk));
+            if (chunk & 0x8080808080808080ull)
+            {
+                break;  // A non-ASCII byte is within the next 8
+            }
+            str += 8;
+        }
+#endif
+        while (str < textEnd && !(U8(*str) & 0x80u))
+        {
+            ++str;
+        }
+        return std::size_t(str - text);
+    }
+
     auto Dim::operator+(const Dim& rhs) const -> Dim
     {
         return Dim{ scale + rhs.scale, offset + rhs.offset };
@@ -123,6 +231,140 @@ namespace retgui
         return !(*this == rhs);
     }
 
+    DimExpr::DimExpr(const Dim& dim) : m_program{ Instruction{ OpCode::Push, dim } }, m_stackDepth(1) {}
+
+    auto DimExpr::min_of(const DimExpr& a, const DimExpr& b) -> DimExpr
+    {
+        return combine(a, b, OpCode::Min);
+    }
+
+    auto DimExpr::max_of(const DimExpr& a, const DimExpr& b) -> DimExpr
+    {
+        return combine(a, b, OpCode::Max);
+    }
+
+    auto DimExpr::clamp(const DimExpr& value, const DimExpr& min, const DimExpr& max) -> DimExpr
+    {
+        return min_of(max_of(value, min), max);
+    }
+
+    auto DimExpr::operator+(const DimExpr& rhs) const -> DimExpr
+    {
+        if (is_single_term() && rhs.is_single_term())
+        {
+            return DimExpr(m_program[0].Term + rhs.m_program[0].Term);  // Still linear
+        }
+        return combine(*this, rhs, OpCode::Add);
+    }
+
+    auto DimExpr::operator-(const DimExpr& rhs) const -> DimExpr
+    {
+        if (is_single_term() && rhs.is_single_term())
+        {
+            return DimExpr(m_program[0].Term - rhs.m_program[0].Term);
+        }
+        return combine(*this, rhs, OpCode::Sub);
+    }
+
+    bool DimExpr::depends_on_parent() const
+    {
+        for (const auto& instruction : m_program)
+        {
+            if (instruction.Op == OpCode::Push && instruction.Term.scale != 0.0f)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    auto DimExpr::combine(const DimExpr& a, const DimExpr& b, OpCode op) -> DimExpr
+    {
+        DimExpr result{};
+        result.m_stackDepth = std::max(std::max(a.m_stackDepth, 1u), std::max(b.m_stackDepth, 1u) + 1);
+        if (result.m_stackDepth > RETGUI_DIM_EXPR_MAX_STACK_DEPTH)
+        {
+            throw std::runtime_error("DimExpr is nested too deeply!");
+        }
+
+        // An empty expression is zero
+        const DimExpr zero{ Dim{} };
+        const auto& lhs = a.m_program.empty() ? zero : a;
+        const auto& rhs = b.m_program.empty() ? zero : b;
+
+        result.m_program.reserve(lhs.m_program.size() + rhs.m_program.size() + 1);
+        result.m_program.insert(result.m_program.end(), lhs.m_program.begin(), lhs.m_program.end());
+        result.m_program.insert(result.m_program.end(), rhs.m_program.begin(), rhs.m_program.end());
+        result.m_program.push_back({ op, Dim{} });
+        return result;
+    }
+
+    auto DimExpr::evaluate_program(float parentSize) const -> float
+    {
+        float stack[RETGUI_DIM_EXPR_MAX_STACK_DEPTH];
+        U32 top = 0;
+        for (const auto& instruction : m_program)
+        {
+            switch (instruction.Op)
+            {
+                case OpCode::Push: stack[top++] = instruction.Term.scale * parentSize + instruction.Term.offset; break;
+                case OpCode::Add: --top; stack[top - 1] += stack[top]; break;
+                case OpCode::Sub: --top; stack[top - 1] -= stack[top]; break;
+                case OpCode::Min: --top; stack[top - 1] = std::min(stack[top - 1], stack[top]); break;
+                case OpCode::Max: --top; stack[top - 1] = std::max(stack[top - 1], stack[top]); break;
+            }
+        }
+        return top > 0 ? stack[0] : 0.0f;
+    }
+
+    auto DrawData::Usage::get_bytes() const -> std::size_t
+    {
+        return DrawCmds * sizeof(DrawCmd) + Vertices * sizeof(DrawVert) + Indices * sizeof(DrawIdx) + Quads * sizeof(DrawQuad);
+    }
+
+    auto DrawData::get_usage() const -> Usage
+    {
+        return { DrawCmds.size(), VertexBuffer.size(), IndexBuffer.size(), QuadBuffer.size() };
+    }
+
+    auto DrawData::get_capacity() const -> Usage
+    {
+        return { DrawCmds.capacity(), VertexBuffer.capacity(), IndexBuffer.capacity(), QuadBuffer.capacity() };
+    }
+
+    void DrawData::clear()
+    {
+        QuadRemap.clear();
+        Layers.assign(1, DrawLayer{});
+        m_currentLayer = 0;
+        m_units.clear();
+        DrawCmds.clear();
+        VertexBuffer.clear();
+        IndexBuffer.clear();
+        QuadBuffer.clear();
+    }
+
+    template <typename T>
+    static void shrink_buffer(std::vector<T>& buffer, std::size_t keep)
+    {
+        if (buffer.capacity() > keep && buffer.size() <= keep)
+        {
+            // shrink_to_fit() is non-binding and would also drop the headroom we want to keep.
+            std::vector<T> shrunk{};
+            shrunk.reserve(keep);
+            shrunk.assign(buffer.begin(), buffer.end());
+            buffer.swap(shrunk);
+        }
+    }
+
+    void DrawData::shrink(const Usage& keep)
+    {
+        shrink_buffer(DrawCmds, keep.DrawCmds);
+        shrink_buffer(VertexBuffer, keep.Vertices);
+        shrink_buffer(IndexBuffer, keep.Indices);
+        shrink_buffer(QuadBuffer, keep.Quads);
+    }
+
     void DrawData::add_draw_cmd(TexId texture)
     {
         if (texture == 0)
@@ -130,17 +372,83 @@ namespace retgui
             texture = get_current_context()->io.Fonts.get_tex_id();
         }
 
+#ifdef RETGUI_TEXTURE_SLOTS
+        if (!DrawCmds.empty())
+        {
+            auto& drawCmd = DrawCmds.back();
+            for (U32 slot = 0; slot < drawCmd.TextureCount; ++slot)
+            {
+                if (drawCmd.Textures[slot] == texture)
+                {
+                    m_currentSlot = U8(slot);
+                    return;
+                }
+            }
+            if (drawCmd.TextureCount < RETGUI_TEXTURE_SLOTS)
+            {
+                m_currentSlot = U8(drawCmd.TextureCount);
+                drawCmd.Textures[drawCmd.TextureCount++] = texture;
+                return;
+            }
+        }
+
+        // No command yet, or every slot is taken: continue in a new command, unless nothing has been drawn with the current one.
+        if (DrawCmds.empty())
+        {
+            DrawCmds.emplace_back(DrawCmd{ texture, 0u, 0u, 0u, 0u, 0u, m_currentLayer });
+        }
+        else if (DrawCmds.back().QuadOffset != get_quad_count())
+        {
+            const auto vertexOffset = DrawCmds.back().VertexOffset;
+            close_draw_cmd();
+            DrawCmds.emplace_back(DrawCmd{ texture, U32(IndexBuffer.size()), 0, get_quad_count(), 0, vertexOffset, m_currentLayer });
+        }
+        auto& drawCmd = DrawCmds.back();
+        drawCmd.TextureId = texture;
+        drawCmd.Textures[0] = texture;
+        drawCmd.TextureCount = 1;
+        m_currentSlot = 0;
+#else
         if (DrawCmds.empty())
         {
-            DrawCmds.emplace_back(DrawCmd{ texture, 0u, 0u });
+            DrawCmds.emplace_back(DrawCmd{ texture, 0u, 0u, 0u, 0u, 0u, m_currentLayer });
         }
         else
         {
-            if (DrawCmds.back().TextureId != texture)
+            if (DrawCmds.back().TextureId == texture)
             {
-                DrawCmds.back().IndexCount = IndexBuffer.size() - DrawCmds.back().IndexOffset;
-                DrawCmds.emplace_back(DrawCmd{ texture, U32(IndexBuffer.size()), 0 });
+                return;
             }
+
+            if (DrawCmds.back().QuadOffset == get_quad_count())
+            {
+                // Nothing has been drawn with the current command yet, so retarget it instead of adding an empty one.
+                const auto* prevCmd = DrawCmds.size() > 1 ? &DrawCmds[DrawCmds.size() - 2] : nullptr;
+                if (prevCmd != nullptr && prevCmd->TextureId == texture && prevCmd->LayerIdx == m_currentLayer)
+                {
+                    DrawCmds.pop_back();
+                }
+                else
+                {
+                    DrawCmds.back().TextureId = texture;
+                }
+                return;
+            }
+
+            const auto vertexOffset = DrawCmds.back().VertexOffset;
+            close_draw_cmd();
+            DrawCmds.emplace_back(DrawCmd{ texture, U32(IndexBuffer.size()), 0, get_quad_count(), 0, vertexOffset, m_currentLayer });
+        }
+#endif
+    }
+
+    void DrawData::close_draw_cmd()
+    {
+        if (!DrawCmds.empty())
+        {
+            auto& drawCmd = DrawCmds.back();
+            drawCmd.IndexCount = U32(IndexBuffer.size()) - drawCmd.IndexOffset;
+            drawCmd.QuadCount = get_quad_count() - drawCmd.QuadOffset;
         }
     }
 
@@ -148,46 +456,401 @@ namespace retgui
 
     void DrawData::add_rect(const Vec2& min, const Vec2& max, std::uint32_t color)
     {
-        const auto& whitePixelCoords = get_current_context()->io.Fonts.get_white_pixel_coords();
+        add_textured_rect(min, max, color, WhitePixelUv, WhitePixelUv);
+    }
 
-        DrawVert a{ min, whitePixelCoords, color };               // TL
-        DrawVert b{ { min.x, max.y }, whitePixelCoords, color };  // BL
-        DrawVert c{ max, whitePixelCoords, color };               // BR
-        DrawVert d{ { max.x, min.y }, whitePixelCoords, color };  // TR
+    void DrawData::add_textured_rect(const Vec2& min, const Vec2& max, std::uint32_t color, const Vec2& uvMin, const Vec2& uvMax)
+    {
+        add_quads(1).write_textured_rect(0, min, max, color, uvMin, uvMax);
+    }
 
-        const auto idxOffset = VertexBuffer.size();
-        VertexBuffer.push_back(a);
-        VertexBuffer.push_back(b);
-        VertexBuffer.push_back(c);
-        VertexBuffer.push_back(d);
+    auto DrawData::reserve_quads(U32 count) -> QuadWriter
+    {
+        if (DrawCmds.empty())
+        {
+            add_draw_cmd(0);
+        }
 
-        IndexBuffer.push_back(idxOffset + 0);
-        IndexBuffer.push_back(idxOffset + 1);
-        IndexBuffer.push_back(idxOffset + 2);
-        IndexBuffer.push_back(idxOffset + 2);
-        IndexBuffer.push_back(idxOffset + 3);
-        IndexBuffer.push_back(idxOffset + 0);
+        if (m_units.empty())
+        {
+            m_units.push_back(DrawUnit{ 0, false });
+        }
+        m_units.back().Patchable = true;
+        return add_quads(count);
     }
 
-    void DrawData::add_textured_rect(const Vec2& min, const Vec2& max, std::uint32_t color, const Vec2& uvMin, const Vec2& uvMax)
+    auto DrawData::add_quads(U32 count) -> QuadWriter
+    {
+        if (DrawCmds.empty())
+        {
+            add_draw_cmd(0);
+        }
+
+        const auto firstQuad = get_quad_count();
+        if (Output == DrawOutput::Quads)
+        {
+            QuadBuffer.resize(QuadBuffer.size() + count);
+            auto writer = QuadWriter{ nullptr, QuadBuffer.data() + firstQuad, WhitePixelUv, firstQuad };
+#ifdef RETGUI_TEXTURE_SLOTS
+            writer.Slot = m_currentSlot;
+#endif
+            return writer;
+        }
+
+        const auto vtxOffset = VertexBuffer.size();
+        const auto idxOffset = IndexBuffer.size();
+        VertexBuffer.resize(vtxOffset + std::size_t(count) * 4);
+        IndexBuffer.resize(idxOffset + std::size_t(count) * 6);
+
+        auto* indices = IndexBuffer.data() + idxOffset;
+        auto chunkOffset = DrawCmds.back().VertexOffset;
+        for (U32 i = 0; i < count; ++i)
+        {
+            const auto vtx = vtxOffset + std::size_t(i) * 4;
+            if (vtx + 4 - chunkOffset > RETGUI_DRAW_IDX_MAX_VERTICES)
+            {
+                // The quad can't be indexed from the current chunk, so continue with the same texture(s) in a new one.
+                auto drawCmd = DrawCmds.back();
+                DrawCmds.back().IndexCount = U32(idxOffset + std::size_t(i) * 6) - drawCmd.IndexOffset;
+                DrawCmds.back().QuadCount = firstQuad + i - drawCmd.QuadOffset;
+                chunkOffset = U32(vtx);
+                drawCmd.IndexOffset = U32(idxOffset + std::size_t(i) * 6);
+                drawCmd.IndexCount = 0;
+                drawCmd.QuadOffset = firstQuad + i;
+                drawCmd.QuadCount = 0;
+                drawCmd.VertexOffset = chunkOffset;
+                DrawCmds.push_back(drawCmd);
+            }
+
+            const auto idx = DrawIdx(vtx - chunkOffset);
+            indices[0] = DrawIdx(idx + 0);
+            indices[1] = DrawIdx(idx + 1);
+            indices[2] = DrawIdx(idx + 2);
+            indices[3] = DrawIdx(idx + 2);
+            indices[4] = DrawIdx(idx + 3);
+            indices[5] = DrawIdx(idx + 0);
+            indices += 6;
+        }
+
+        auto writer = QuadWriter{ VertexBuffer.data() + vtxOffset, nullptr, WhitePixelUv, firstQuad };
+#ifdef RETGUI_TEXTURE_SLOTS
+        writer.Slot = m_currentSlot;
+#endif
+        return writer;
+    }
+
+    void DrawData::write_textured_rect(U32 quadIdx, const Vec2& min, const Vec2& max, std::uint32_t color, const Vec2& uvMin, const Vec2& uvMax)
+    {
+        if (!QuadRemap.empty())
+        {
+            quadIdx = QuadRemap[quadIdx];
+        }
+
+        auto writer = Output == DrawOutput::Quads ? QuadWriter{ nullptr, QuadBuffer.data(), WhitePixelUv, 0 }
+                                                  : QuadWriter{ VertexBuffer.data(), nullptr, WhitePixelUv, 0 };
+#ifdef RETGUI_TEXTURE_SLOTS
+        // Keep the texture the quad was added with.
+        writer.Slot = Output == DrawOutput::Quads ? QuadBuffer[quadIdx].Slot : VertexBuffer[std::size_t(quadIdx) * 4].slot;
+#endif
+        writer.write_textured_rect(quadIdx, min, max, color, uvMin, uvMax);
+    }
+
+    static bool rects_overlap(const Rect& a, const Rect& b)
+    {
+        return a.tl.x < b.br.x && b.tl.x < a.br.x && a.tl.y < b.br.y && b.tl.y < a.br.y;
+    }
+
+    static void grow_rect(Rect& rect, const Rect& other)
+    {
+        rect.tl = { std::min(rect.tl.x, other.tl.x), std::min(rect.tl.y, other.tl.y) };
+        rect.br = { std::max(rect.br.x, other.br.x), std::max(rect.br.y, other.br.y) };
+    }
+
+    auto DrawData::push_layer(const Vec2& translation, float opacity) -> U32
+    {
+        const auto layerIdx = U32(Layers.size());
+        Layers.push_back(DrawLayer{ {}, 1.0f, m_currentLayer, translation, opacity });
+        set_layer_params(layerIdx, translation, opacity);
+        set_current_layer(layerIdx);
+        return layerIdx;
+    }
+
+    void DrawData::pop_layer()
+    {
+        set_current_layer(Layers[m_currentLayer].Parent);
+    }
+
+    void DrawData::set_layer_params(U32 layerIdx, const Vec2& translation, float opacity)
+    {
+        Layers[layerIdx].LocalTranslation = translation;
+        Layers[layerIdx].LocalOpacity = opacity;
+
+        // Layers are added depth first, so the layers below this one follow it, each after its parent. Those have a parent of
+        // layerIdx or later, any other layer recomputed along the way is left as it was.
+        for (auto i = std::size_t(layerIdx); i < Layers.size(); ++i)
+        {
+            auto& layer = Layers[i];
+            if (i != layerIdx && layer.Parent < layerIdx)
+            {
+                continue;
+            }
+            const auto& parent = Layers[layer.Parent];
+            layer.Translation = parent.Translation + layer.LocalTranslation;
+            layer.Opacity = parent.Opacity * layer.LocalOpacity;
+        }
+    }
+
+    void DrawData::set_current_layer(U32 layerIdx)
+    {
+        if (m_currentLayer == layerIdx)
+        {
+            return;
+        }
+        m_currentLayer = layerIdx;
+
+        if (DrawCmds.empty())
+        {
+            return;  // The first add_draw_cmd() picks it up
+        }
+        if (DrawCmds.back().QuadOffset == get_quad_count())
+        {
+            DrawCmds.back().LayerIdx = layerIdx;  // Nothing drawn with the current command yet
+            return;
+        }
+
+        // Continue with the same texture(s) in a command of the layer.
+        auto drawCmd = DrawCmds.back();
+        close_draw_cmd();
+        drawCmd.IndexOffset = U32(IndexBuffer.size());
+        drawCmd.IndexCount = 0;
+        drawCmd.QuadOffset = get_quad_count();
+        drawCmd.QuadCount = 0;
+        drawCmd.LayerIdx = layerIdx;
+        DrawCmds.push_back(drawCmd);
+    }
+
+    void DrawData::begin_unit()
+    {
+        const auto quadCount = get_quad_count();
+        if (!m_units.empty() && m_units.back().FirstQuad == quadCount)
+        {
+            return;  // The previous unit drew nothing
+        }
+        m_units.push_back(DrawUnit{ quadCount, false });
+    }
+
+    void DrawData::batch_draw_cmds()
     {
-        DrawVert a{ min, uvMin, color };                              // TL
-        DrawVert b{ { min.x, max.y }, { uvMin.x, uvMax.y }, color };  // BL
-        DrawVert c{ max, uvMax, color };                              // BR
-        DrawVert d{ { max.x, min.y }, { uvMax.x, uvMin.y }, color };  // TR
-
-        const auto idxOffset = VertexBuffer.size();
-        VertexBuffer.push_back(a);
-        VertexBuffer.push_back(b);
-        VertexBuffer.push_back(c);
-        VertexBuffer.push_back(d);
-
-        IndexBuffer.push_back(idxOffset + 0);
-        IndexBuffer.push_back(idxOffset + 1);
-        IndexBuffer.push_back(idxOffset + 2);
-        IndexBuffer.push_back(idxOffset + 2);
-        IndexBuffer.push_back(idxOffset + 3);
-        IndexBuffer.push_back(idxOffset + 0);
+#ifdef RETGUI_TEXTURE_SLOTS
+        constexpr bool hasTextureSlots = true;
+#else
+        constexpr bool hasTextureSlots = false;
+#endif
+        if (hasTextureSlots || DrawCmds.size() < 3)
+        {
+            return;  // With slots, moving quads between commands would invalidate their slot indices
+        }
+
+        // Cut the commands into pieces at the unit starts.
+        m_pieces.clear();
+        std::size_t unitIdx = 0;
+        bool patchable = false;
+        for (const auto& drawCmd : DrawCmds)
+        {
+            const auto cmdEnd = drawCmd.QuadOffset + drawCmd.QuadCount;
+            auto pieceStart = drawCmd.QuadOffset;
+            while (pieceStart < cmdEnd)
+            {
+                while (unitIdx < m_units.size() && m_units[unitIdx].FirstQuad <= pieceStart)
+                {
+                    patchable = m_units[unitIdx++].Patchable;
+                }
+                const auto pieceEnd = unitIdx < m_units.size() ? std::min(cmdEnd, m_units[unitIdx].FirstQuad) : cmdEnd;
+                m_pieces.push_back(DrawPiece{ drawCmd.TextureId, pieceStart, pieceEnd - pieceStart, {}, patchable, drawCmd.LayerIdx, 0 });
+                pieceStart = pieceEnd;
+            }
+        }
+
+        // Bounds of what each piece draws. Zero-sized quads draw nothing, so they don't count.
+        const auto pieceCount = U32(m_pieces.size());
+        for (auto& piece : m_pieces)
+        {
+            piece.Bounds = Rect{ { FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX } };
+            for (U32 quadIdx = piece.QuadOffset; quadIdx < piece.QuadOffset + piece.QuadCount; ++quadIdx)
+            {
+                Rect quad{};
+                if (Output == DrawOutput::Quads)
+                {
+                    quad = { QuadBuffer[quadIdx].Min, QuadBuffer[quadIdx].Max };
+                }
+                else
+                {
+                    quad = { VertexBuffer[std::size_t(quadIdx) * 4].get_pos(), VertexBuffer[std::size_t(quadIdx) * 4 + 2].get_pos() };
+                }
+                if (quad.width() > 0.0f && quad.height() > 0.0f)
+                {
+                    grow_rect(piece.Bounds, quad);
+                }
+            }
+            piece.NextInBatch = pieceCount;
+        }
+
+        // Each piece joins the latest batch of its texture, unless it overlaps something drawn by a batch in between.
+        m_batches.clear();
+        for (U32 pieceIdx = 0; pieceIdx < pieceCount; ++pieceIdx)
+        {
+            auto& piece = m_pieces[pieceIdx];
+
+            DrawBatch* target = nullptr;
+            if (!piece.Patchable)
+            {
+                const auto lookbackEnd = m_batches.size() > RETGUI_DRAW_BATCH_LOOKBACK ? m_batches.size() - RETGUI_DRAW_BATCH_LOOKBACK : 0;
+                for (auto batchIdx = m_batches.size(); batchIdx > lookbackEnd; --batchIdx)
+                {
+                    auto& batch = m_batches[batchIdx - 1];
+                    if (batch.Barrier || batch.Layer != piece.Layer)
+                    {
+                        break;
+                    }
+                    if (batch.Texture == piece.Texture)
+                    {
+                        target = &batch;
+                        break;
+                    }
+                    if (rects_overlap(piece.Bounds, batch.Bounds))
+                    {
+                        // The batch as a whole overlaps, check which of its pieces do.
+                        bool overlaps = false;
+                        for (auto member = batch.FirstPiece; member != pieceCount && !overlaps; member = m_pieces[member].NextInBatch)
+                        {
+                            overlaps = rects_overlap(piece.Bounds, m_pieces[member].Bounds);
+                        }
+                        if (overlaps)
+                        {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (target == nullptr)
+            {
+                m_batches.push_back(DrawBatch{ piece.Texture, piece.Bounds, pieceIdx, pieceIdx, piece.Layer, piece.Patchable });
+                continue;
+            }
+            grow_rect(target->Bounds, piece.Bounds);
+            m_pieces[target->LastPiece].NextInBatch = pieceIdx;
+            target->LastPiece = pieceIdx;
+        }
+
+        std::size_t mergedCmdCount = 0;
+        for (std::size_t batchIdx = 0; batchIdx < m_batches.size(); ++batchIdx)
+        {
+            const auto& batch = m_batches[batchIdx];
+            mergedCmdCount += batchIdx == 0 || m_batches[batchIdx - 1].Texture != batch.Texture || m_batches[batchIdx - 1].Layer != batch.Layer;
+        }
+        if (mergedCmdCount >= DrawCmds.size())
+        {
+            return;  // Nothing to gain
+        }
+
+        // Rebuild the buffers in batch order.
+        QuadRemap.resize(get_quad_count());
+        VertexBuffer.swap(m_unbatchedVertices);
+        QuadBuffer.swap(m_unbatchedQuads);
+        DrawCmds.clear();
+        VertexBuffer.clear();
+        IndexBuffer.clear();
+        QuadBuffer.clear();
+        m_units.clear();
+
+        for (const auto& batch : m_batches)
+        {
+            set_current_layer(batch.Layer);
+            add_draw_cmd(batch.Texture);
+            for (auto pieceIdx = batch.FirstPiece; pieceIdx != pieceCount; pieceIdx = m_pieces[pieceIdx].NextInBatch)
+            {
+                const auto& piece = m_pieces[pieceIdx];
+                const auto writer = add_quads(piece.QuadCount);
+                if (Output == DrawOutput::Quads)
+                {
+                    std::copy_n(m_unbatchedQuads.data() + piece.QuadOffset, piece.QuadCount, writer.Quads);
+                }
+                else
+                {
+                    std::copy_n(m_unbatchedVertices.data() + std::size_t(piece.QuadOffset) * 4, std::size_t(piece.QuadCount) * 4, writer.Vertices);
+                }
+                for (U32 i = 0; i < piece.QuadCount; ++i)
+                {
+                    QuadRemap[piece.QuadOffset + i] = writer.FirstQuad + i;
+                }
+            }
+        }
+        close_draw_cmd();
+        m_currentLayer = 0;
+    }
+
+    void DrawData::add_text(const Font& font, const Vec2& pos, std::uint32_t color, const char* text, const char* textEnd)
+    {
+        auto& io = get_current_context()->io;
+        add_draw_cmd(io.Fonts.get_tex_id());
+        U32 currentPage = 0;
+
+        float x = pos.x;  // Align to be pixel perfect
+        float y = pos.y;  // Align to be pixel-perfect
+
+        y += float(font.Ascender);
+
+        utf8_for_each(text, textEnd, [&](U32 character) {
+            if (character == '\n')
+            {
+                x = pos.x;
+                y += font.LineSpacing;
+                return;
+            }
+
+            auto* glyph = font.get_glyph(character);
+            if (glyph == nullptr)
+            {
+                glyph = font.get_glyph('?');
+            }
+            if (glyph == nullptr)
+            {
+                // The font has no glyphs yet (eg. it is still being built asynchronously), so draw a block per character.
+                const auto blockAdvance = std::roundf(font.FontSize * 0.5f);
+                if (character != ' ')
+                {
+                    if (currentPage != 0)
+                    {
+                        // The white pixels live on the first page.
+                        add_draw_cmd(io.Fonts.get_tex_id());
+                        currentPage = 0;
+                    }
+                    Vec2 blockTL = { std::roundf(x), std::roundf(y - font.Ascender * 0.5f) };
+                    Vec2 blockBR = { std::roundf(x + blockAdvance * 0.75f), std::roundf(y) };
+                    add_rect(blockTL, blockBR, color);
+                }
+                x += blockAdvance;
+                return;
+            }
+
+            if (glyph->Page != currentPage)
+            {
+                // Only split the draw command where the text crosses onto another atlas page.
+                add_draw_cmd(io.Fonts.get_tex_id(glyph->Page));
+                currentPage = glyph->Page;
+            }
+
+            Vec2 quadTL = { std::roundf(x + glyph->x0), std::roundf(y + glyph->y0) };
+            Vec2 quadBR = { std::roundf(x + glyph->x1), std::roundf(y + glyph->y1) };
+            Vec2 uvMin = { glyph->ux0, glyph->uy0 };
+            Vec2 uvMax = { glyph->ux1, glyph->uy1 };
+
+            add_textured_rect(quadTL, quadBR, color, uvMin, uvMax);
+
+            float kerningOffset = 0.0f;
+            x += glyph->AdvanceX + kerningOffset;
+        });
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include <retgui/fonts.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <exception>
+
+/*
+ * retgui_fontc - Compiles a font into a C++ header holding its alpha8 bitmap & glyph metrics as constexpr data.
+ *
+ * Usage: retgui_fontc <font file> <font size> <name> <output header> [<first codepoint>-<last codepoint> ...]
+ *
+ * Codepoints may be decimal or hex (0x...). Defaults to Basic Latin + Latin Supplement, the same as Fonts::add_font_from_file().
+ */
+
+static auto parse_charset_range(const std::string& arg) -> retgui::CharsetRange
+{
+    const auto separator = arg.find('-');
+    if (separator == std::string::npos)
+    {
+        const auto codePoint = std::int32_t(std::stoul(arg, nullptr, 0));
+        return { codePoint, codePoint };
+    }
+    return { std::int32_t(std::stoul(arg.substr(0, separator), nullptr, 0)), std::int32_t(std::stoul(arg.substr(separator + 1), nullptr, 0)) };
+}
+
+static auto format_float(float value) -> std::string
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%#.9gf", value);
+    return buffer;
+}
+
+static void write_header(std::ostream& out,
+                         const std::string& name,
+                         const retgui::Font& font,
+                         const std::vector<retgui::BakedGlyph>& glyphs,
+                         const std::vector<retgui::U8>& pixels,
+                         retgui::U32 width,
+                         retgui::U32 height)
+{
+    out << "// Generated by retgui_fontc. Do not edit.\n";
+    out << "#pragma once\n\n";
+    out << "#include <retgui/fonts.hpp>\n\n";
+    out << "namespace retgui_fonts\n{\n";
+
+    out << "    inline constexpr retgui::U8 " << name << "_pixels[] = {";
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+    {
+        if (i % 32 == 0)
+        {
+            out << "\n        ";
+        }
+        out << unsigned(pixels[i]) << ",";
+    }
+    out << "\n    };\n\n";
+
+    out << "    inline constexpr retgui::BakedGlyph " << name << "_glyphs[] = {\n";
+    for (const auto& glyph : glyphs)
+    {
+        out << "        { " << glyph.CodePoint << ", " << glyph.x0 << ", " << glyph.y0 << ", " << glyph.x1 << ", " << glyph.y1 << ", "
+            << format_float(glyph.AdvanceX) << ", " << glyph.X << ", " << glyph.Y << " },\n";
+    }
+    out << "    };\n\n";
+
+    out << "    inline constexpr retgui::EmbeddedFont " << name << " = {\n";
+    out << "        " << format_float(font.FontSize) << ",\n";
+    out << "        " << format_float(font.Ascender) << ",\n";
+    out << "        " << format_float(font.Descender) << ",\n";
+    out << "        " << format_float(font.LineSpacing) << ",\n";
+    out << "        " << format_float(font.LineGap) << ",\n";
+    out << "        " << format_float(font.MaxAdvanceWidth) << ",\n";
+    out << "        " << name << "_glyphs,\n";
+    out << "        " << glyphs.size() << ",\n";
+    out << "        " << name << "_pixels,\n";
+    out << "        " << width << ",\n";
+    out << "        " << height << ",\n";
+    out << "    };\n";
+
+    out << "}\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5)
+    {
+        std::cerr << "Usage: retgui_fontc <font file> <font size> <name> <output header> [<first codepoint>-<last codepoint> ...]"
+                  << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        const std::string fontFilename = argv[1];
+        const float fontSize = std::stof(argv[2]);
+        const std::string name = argv[3];
+        const std::string outputFilename = argv[4];
+
+        std::vector<retgui::CharsetRange> charsetRanges{};
+        for (int i = 5; i < argc; ++i)
+        {
+            charsetRanges.push_back(parse_charset_range(argv[i]));
+        }
+
+        // Same path as at runtime, only the result is written out instead of uploaded.
+        retgui::Fonts fonts{};
+        const auto* font = fonts.add_font_from_file(fontFilename, fontSize, charsetRanges);
+
+        std::vector<retgui::BakedGlyph> glyphs{};
+        std::vector<retgui::U8> pixels{};
+        retgui::U32 width{};
+        retgui::U32 height{};
+        fonts.bake_font(font, glyphs, pixels, width, height);
+
+        std::ofstream file(outputFilename);
+        write_header(file, name, *font, glyphs, pixels, width, height);
+        if (!file)
+        {
+            std::cerr << "Failed to write " << outputFilename << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "retgui_fontc: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}